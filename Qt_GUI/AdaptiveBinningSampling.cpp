@@ -23,7 +23,7 @@ std::vector<std::weak_ptr<BinningTreeNode>> AdaptiveBinningSampling::getAllLeave
 	return leaves;
 }
 
-std::pair<PointSet, PointSet>* AdaptiveBinningSampling::execute(const FilteredPointSet * origin, const QRect& bounding_rect, bool is_1st)
+std::pair<PointSet, PointSet>* AdaptiveBinningSampling::execute(const PointStore * origin, const QRect& bounding_rect, bool is_1st)
 {
 	if (origin->empty()) return new std::pair<PointSet, PointSet>();;
 
@@ -108,7 +108,7 @@ Indices AdaptiveBinningSampling::KDTreeGuidedSampling()
 	return samples;
 }
 
-std::pair<PointSet, PointSet>* AdaptiveBinningSampling::executeWithoutCallback(const FilteredPointSet * origin, const QRect& bounding_rect, bool is_1st)
+std::pair<PointSet, PointSet>* AdaptiveBinningSampling::executeWithoutCallback(const PointStore * origin, const QRect& bounding_rect, bool is_1st)
 {
 	if (origin->empty()) return new std::pair<PointSet, PointSet>();
 
@@ -197,11 +197,12 @@ pair<PointSet, PointSet>* AdaptiveBinningSampling::findRemovedAndAdded(const Ind
 	sort(current.begin(), current.end());
 	set_difference(last_seeds.begin(), last_seeds.end(), current.begin(), current.end(), back_inserter(removed_idx));
 	set_difference(current.begin(), current.end(), last_seeds.begin(), last_seeds.end(), back_inserter(added_idx));
+	const PointStore* dataset = tree->getDataset();
 	PointSet removed, added;
 	for (auto idx : removed_idx)
-		removed.push_back(make_unique<LabeledPoint>(tree->getDataset()->at(idx)));
+		removed.push_back(dataset->at(dataset->indexOf(idx)));
 	for (auto idx : added_idx)
-		added.push_back(make_unique<LabeledPoint>(tree->getDataset()->at(idx)));
+		added.push_back(dataset->at(dataset->indexOf(idx)));
 	last_seeds = move(current);
 	return new pair<PointSet, PointSet>(move(removed), move(added));
 }
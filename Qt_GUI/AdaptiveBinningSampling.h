@@ -28,8 +28,8 @@ public:
 	std::vector<std::weak_ptr<BinningTreeNode>> getAllLeaves();
 
 	/* main function that contains the framework */
-	std::pair<PointSet, PointSet>* execute(const FilteredPointSet* origin, const QRect& bounding_rect, bool is_1st);
-	std::pair<PointSet, PointSet>* executeWithoutCallback(const FilteredPointSet* origin, const QRect& bounding_rect, bool is_1st);
+	std::pair<PointSet, PointSet>* execute(const PointStore* origin, const QRect& bounding_rect, bool is_1st);
+	std::pair<PointSet, PointSet>* executeWithoutCallback(const PointStore* origin, const QRect& bounding_rect, bool is_1st);
 
 	// determine class labels and select samples
 	Indices KDTreeGuidedSampling();
@@ -4,11 +4,11 @@ TreeParams tree_sampling_params = { 0.003, 0.013, 4 };
 
 using namespace std;
 
-BinningTree::BinningTree(const FilteredPointSet* origin, const QRect& bounding_rect)
+BinningTree::BinningTree(const PointStore* origin, const QRect& bounding_rect)
 	: horizontal_bin_num(bounding_rect.width() / params.grid_width + 1), vertical_bin_num(bounding_rect.height() / params.grid_width + 1), margin_left(bounding_rect.left()), margin_top(bounding_rect.top())
 {
 	// create all min grids
-	dataset = make_unique<FilteredPointSet>();
+	dataset = make_unique<PointStore>();
 	updateMinGrids(origin);
 }
 
@@ -199,28 +199,28 @@ NodeWithQuota BinningTree::backtrack(shared_ptr<BinningTreeNode> leaf, uint max_
 	return result;
 }
 
-void BinningTree::updateMinGrids(const FilteredPointSet * origin)
+void BinningTree::updateMinGrids(const PointStore * origin)
 {
 	vector<weak_ptr<MinGrid>> vec;
 	for (auto &pr : min_grids) {
 		vec.push_back(pr.second);
 	}
-	for (auto &pr : *origin) {
-		auto &p = pr.second;
-		int x = visual2grid(p->pos.x(), margin_left),
-			y = visual2grid(p->pos.y(), margin_top);
+	for (size_t k = 0, sz = origin->size(); k < sz; ++k) {
+		uint label = origin->label[k];
+		int x = visual2grid(origin->x[k], margin_left),
+			y = visual2grid(origin->y[k], margin_top);
 		auto &pos = make_pair(x, y);
 		if (min_grids.find(pos) == min_grids.end()) {
 			min_grids[pos] = make_shared<MinGrid>(x, y);
 			vec.push_back(min_grids[pos]);
-			dataset->emplace(pr.first, make_unique<LabeledPoint>(pr.second)); // when selecting seeds, the position is always the first one in *contents*
+			dataset->push_back(*origin, k); // when selecting seeds, the position is always the first one in *contents*
 		}
 		else if (double_dist(gen) < 0.1) {
-			dataset->at(min_grids[pos]->contents.front())->label = pr.second->label;
+			dataset->label[dataset->indexOf(min_grids[pos]->contents.front())] = label;
 		}
-		min_grids[pos]->contents.push_back(pr.first);
+		min_grids[pos]->contents.push_back(origin->id[k]);
 		++grid_infos[pos].total_num;
-		++grid_infos[pos].class_point_num[p->label];
+		++grid_infos[pos].class_point_num[label];
 	}
 	vec.shrink_to_fit();
 	StatisticalInfo info = countStatisticalInfo(vec);
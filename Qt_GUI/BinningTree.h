@@ -72,10 +72,10 @@ typedef std::pair<std::weak_ptr<BinningTreeNode>, std::unordered_map<uint, size_
 class BinningTree
 {
 public:
-	BinningTree(const FilteredPointSet* origin, const QRect& bounding_rect);
+	BinningTree(const PointStore* origin, const QRect& bounding_rect);
 
 	std::weak_ptr<BinningTreeNode> getRoot() { return root; }
-	const FilteredPointSet* getDataset() { return dataset.get(); }
+	const PointStore* getDataset() { return dataset.get(); }
 
 	bool split(std::shared_ptr<BinningTreeNode> node);
 	bool split_new(std::shared_ptr<BinningTreeNode> node);
@@ -84,7 +84,7 @@ public:
 	uint selectSeedIndex(std::shared_ptr<BinningTreeNode> node, uint label);
 
 	void updateLeafNum(std::shared_ptr<BinningTreeNode> node);
-	void updateMinGrids(const FilteredPointSet* origin);
+	void updateMinGrids(const PointStore* origin);
 
 	NodeWithQuota backtrack(std::shared_ptr<BinningTreeNode> leaf, uint max_depth);
 
@@ -99,7 +99,7 @@ private:
 	
 	std::shared_ptr<BinningTreeNode> root;
 
-	std::unique_ptr<FilteredPointSet> dataset; // original dataset
+	std::unique_ptr<PointStore> dataset; // original dataset
 
 	struct pairhash {
 	public:
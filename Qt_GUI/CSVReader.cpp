@@ -0,0 +1,375 @@
+#include "CSVReader.h"
+
+#include <algorithm>
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CSV_USE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+using namespace std;
+
+const static size_t CSV_BLOCK_BYTES = 4 << 20;
+const static uint UNMAPPED_CLASS = static_cast<uint>(-1);
+
+namespace {
+
+#ifdef CSV_USE_SSE2
+inline int countTrailingZeros(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return static_cast<int>(idx);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// returns the first position in [p, end) holding c or '\n', or end if there is none
+inline const char* findSeparator(const char* p, const char* end, char c)
+{
+#ifdef CSV_USE_SSE2
+	const __m128i sep = _mm_set1_epi8(c), nl = _mm_set1_epi8('\n');
+	for (; end - p >= 16; p += 16) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, sep), _mm_cmpeq_epi8(block, nl)));
+		if (mask)
+			return p + countTrailingZeros(mask);
+	}
+#endif
+	for (; p < end; ++p)
+		if (*p == c || *p == '\n')
+			return p;
+	return end;
+}
+
+// same result as atof() on the text in [p, end)
+double slowParseNumber(const char* p, const char* end)
+{
+	char buf[64];
+	size_t len = end - p;
+	if (len < sizeof(buf)) {
+		memcpy(buf, p, len);
+		buf[len] = '\0';
+		return atof(buf);
+	}
+	return atof(string(p, end).c_str());
+}
+
+const double exact_powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// parses a decimal number in [p, end), the result is correctly rounded as long as the significand fits into 53 bits
+// and the decimal exponent is at most 22 (Clinger's fast path), otherwise it falls back to atof()
+double parseNumber(const char* p, const char* end)
+{
+	const char* begin = p;
+	while (p < end && (*p == ' ' || *p == '\t')) ++p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	uint64_t significand = 0;
+	int digits = 0, exponent = 0;
+	bool exact = true, has_digits = false;
+	for (; p < end && static_cast<unsigned>(*p - '0') < 10; ++p) {
+		has_digits = true;
+		if (digits < 19) {
+			significand = significand * 10 + (*p - '0');
+			if (significand) ++digits;
+		}
+		else {
+			exact = false;
+		}
+	}
+	if (p < end && *p == '.') {
+		for (++p; p < end && static_cast<unsigned>(*p - '0') < 10; ++p) {
+			has_digits = true;
+			if (digits < 19) {
+				significand = significand * 10 + (*p - '0');
+				if (significand) ++digits;
+				--exponent;
+			}
+			else {
+				exact = false;
+			}
+		}
+	}
+	if (!has_digits)
+		return slowParseNumber(begin, end);
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		bool negative_exp = false;
+		if (q < end && (*q == '-' || *q == '+'))
+			negative_exp = *q++ == '-';
+		if (q < end && static_cast<unsigned>(*q - '0') < 10) {
+			int e = 0;
+			for (; q < end && static_cast<unsigned>(*q - '0') < 10; ++q)
+				if (e < 10000) e = e * 10 + (*q - '0');
+			exponent += negative_exp ? -e : e;
+			p = q;
+		}
+	}
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+
+	if (p != end || !exact || significand > (1ull << 53) || exponent < -22 || exponent > 22)
+		return slowParseNumber(begin, end);
+	double val = static_cast<double>(significand);
+	val = exponent < 0 ? val / exact_powers_of_ten[-exponent] : val * exact_powers_of_ten[exponent];
+	return negative ? -val : val;
+}
+
+// number of days from 1970-01-01 to the given date of the proleptic Gregorian calendar
+qint64 daysFromCivil(qint64 y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+	qint64 era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = static_cast<unsigned>(y - era * 400);
+	unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+// reads exactly n digits at p
+inline bool parseDigits(const char*& p, const char* end, int n, unsigned* out)
+{
+	if (end - p < n) return false;
+	unsigned v = 0;
+	for (int i = 0; i < n; ++i, ++p) {
+		unsigned digit = static_cast<unsigned>(*p - '0');
+		if (digit >= 10) return false;
+		v = v * 10 + digit;
+	}
+	*out = v;
+	return true;
+}
+
+// parses "yyyy-MM-dd[( |T)HH:mm[:ss]]" in [p, end) to seconds since 1970-01-01 UTC
+bool parseTimestamp(const char* p, const char* end, qint64* seconds)
+{
+	const static unsigned days_in_month[] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	unsigned y, m, d, hh = 0, mm = 0, ss = 0;
+	while (p < end && (*p == ' ' || *p == '\t')) ++p;
+	if (!parseDigits(p, end, 4, &y) || p == end || *p++ != '-' || !parseDigits(p, end, 2, &m) ||
+		p == end || *p++ != '-' || !parseDigits(p, end, 2, &d))
+		return false;
+	if (m < 1 || m > 12 || d < 1 || d > days_in_month[m - 1] ||
+		(m == 2 && d == 29 && (y % 4 != 0 || (y % 100 == 0 && y % 400 != 0))))
+		return false;
+	if (end - p > 1 && (*p == ' ' || *p == 'T') && static_cast<unsigned>(p[1] - '0') < 10) {
+		++p;
+		if (!parseDigits(p, end, 2, &hh) || p == end || *p++ != ':' || !parseDigits(p, end, 2, &mm))
+			return false;
+		if (p < end && *p == ':' && (++p, !parseDigits(p, end, 2, &ss)))
+			return false;
+		if (hh > 23 || mm > 59 || ss > 59)
+			return false;
+	}
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+	if (p != end)
+		return false;
+	*seconds = daysFromCivil(y, m, d) * SECONDS_PER_DAY + hh * 3600 + mm * 60 + ss;
+	return true;
+}
+
+}
+
+void CSVReader::open(const string& filename)
+{
+	close();
+	file.open(filename);
+	labels.clear();
+	last_class = 0;
+
+	//skip invalid char
+	while (next_byte < file.size() && static_cast<signed char>(file.data()[next_byte]) < 0) ++next_byte;
+	with_date = params.is_streaming;
+	submitBlocks();
+}
+
+void CSVReader::close()
+{
+	for (auto& b : blocks) // the pending ranges point into the mapping
+		b.wait();
+	blocks.clear();
+	current = Block();
+	row = 0;
+	next_byte = 0;
+	file.close();
+}
+
+const char* CSVReader::parseRow(const char* row, const char* end, bool with_date, Row* out)
+{
+	const char* p = row;
+	const char* sep;
+	if (with_date) {
+		sep = findSeparator(p, end, ',');
+		if (!parseTimestamp(p, sep, &out->time))
+			out->time = 0;
+		p = sep < end && *sep == ',' ? sep + 1 : sep;
+	}
+	sep = findSeparator(p, end, ',');
+	out->x = parseNumber(p, sep);
+	p = sep < end && *sep == ',' ? sep + 1 : sep;
+	sep = findSeparator(p, end, ',');
+	out->y = parseNumber(p, sep);
+	p = sep < end && *sep == ',' ? sep + 1 : sep;
+
+	sep = findSeparator(p, end, '\n');
+	out->label_begin = p;
+	out->label_end = sep > p && sep[-1] == '\r' ? sep - 1 : sep;
+	return sep < end ? sep + 1 : end;
+}
+
+CSVReader::Block CSVReader::parseBlock(const char* data, size_t begin, size_t end, bool with_date)
+{
+	Block b;
+	b.begin = begin;
+	size_t capacity = (end - begin) / 32; // rough guess of the row length
+	b.row_end.reserve(capacity), b.x.reserve(capacity), b.y.reserve(capacity), b.label.reserve(capacity);
+	if (with_date)
+		b.time.reserve(capacity);
+
+	Row r;
+	uint last = 0;
+	for (const char* p = data + begin, *e = data + end; p < e;) {
+		if (*p == '\n' || *p == '\r') { // skip empty lines
+			++p;
+			continue;
+		}
+		p = parseRow(p, e, with_date, &r);
+
+		size_t len = r.label_end - r.label_begin;
+		auto same = [&](const string& s) { return s.size() == len && memcmp(s.data(), r.label_begin, len) == 0; };
+		if (last >= b.labels.size() || !same(b.labels[last])) {
+			last = static_cast<uint>(find_if(b.labels.begin(), b.labels.end(), same) - b.labels.begin());
+			if (last == b.labels.size())
+				b.labels.emplace_back(r.label_begin, len);
+		}
+		b.row_end.push_back(static_cast<uint>(p - data - begin));
+		b.x.push_back(static_cast<float>(r.x));
+		b.y.push_back(static_cast<float>(r.y));
+		b.label.push_back(last);
+		if (with_date)
+			b.time.push_back(r.time);
+	}
+	return b;
+}
+
+void CSVReader::submitBlocks()
+{
+	ThreadPool& pool = ThreadPool::global();
+	const char* data = file.data();
+	while (next_byte < file.size() && blocks.size() < 2 * pool.size() + 1) {
+		size_t begin = next_byte, end = min(file.size(), begin + CSV_BLOCK_BYTES);
+		if (end < file.size()) { // extend the range to the end of its last row
+			const char* nl = static_cast<const char*>(memchr(data + end, '\n', file.size() - end));
+			end = nl ? nl - data + 1 : file.size();
+		}
+		bool date = with_date;
+		blocks.push_back(pool.submit([data, begin, end, date]() { return parseBlock(data, begin, end, date); }));
+		next_byte = end;
+	}
+}
+
+void CSVReader::restart()
+{
+	size_t resume;
+	if (row < current.x.size())
+		resume = current.begin + (row ? current.row_end[row - 1] : 0);
+	else if (!blocks.empty()) {
+		resume = blocks.front().get().begin;
+		blocks.pop_front();
+	}
+	else
+		resume = next_byte;
+	for (auto& b : blocks)
+		b.wait();
+	blocks.clear();
+	current = Block();
+	row = 0;
+	next_byte = resume;
+	with_date = params.is_streaming;
+	submitBlocks();
+}
+
+bool CSVReader::nextBlock()
+{
+	while (row == current.x.size()) {
+		if (blocks.empty())
+			return false;
+		current = blocks.front().get();
+		blocks.pop_front();
+		row = 0;
+		local2class.assign(current.labels.size(), UNMAPPED_CLASS);
+		submitBlocks();
+	}
+	return true;
+}
+
+uint CSVReader::classOf(const string& label, unordered_map<uint, string>* class2label)
+{
+	if (last_class < labels.size() && labels[last_class] == label)
+		return last_class;
+	for (uint c = 0; c < labels.size(); ++c) {
+		if (labels[c] == label)
+			return last_class = c;
+	}
+	// mapping label (string) to class (unsigned int)
+	last_class = static_cast<uint>(labels.size());
+	labels.push_back(label);
+	class2label->emplace(last_class, label);
+	return last_class;
+}
+
+PointChunk CSVReader::read(unordered_map<uint, string>* class2label)
+{
+	if (class2label->size() != labels.size()) { // the mapping has been modified outside
+		labels.assign(class2label->size(), string());
+		for (auto& u : *class2label)
+			if (u.first < labels.size()) labels[u.first] = u.second;
+		last_class = 0;
+		fill(local2class.begin(), local2class.end(), UNMAPPED_CLASS);
+	}
+	if (with_date != params.is_streaming)
+		restart();
+
+	chunk_x.clear(), chunk_y.clear(), chunk_label.clear(), chunk_time.clear();
+	if (!params.is_streaming) {
+		chunk_x.reserve(params.chunk_size), chunk_y.reserve(params.chunk_size), chunk_label.reserve(params.chunk_size);
+	}
+
+	qint64 last_time = 0;
+	while (nextBlock()) {
+		if (!params.is_streaming && chunk_x.size() == params.chunk_size)
+			break;
+		if (params.is_streaming) {
+			qint64 time = toTimeUnits(current.time[row], params.time_unit);
+			if (!chunk_x.empty() && time - last_time >= params.time_step)
+				break;
+			last_time = time;
+			chunk_time.push_back(current.time[row]);
+		}
+
+		uint& c = local2class[current.label[row]];
+		if (c == UNMAPPED_CLASS) // classes are registered in order of first appearance in the file
+			c = classOf(current.labels[current.label[row]], class2label);
+		chunk_x.push_back(current.x[row]);
+		chunk_y.push_back(current.y[row]);
+		chunk_label.push_back(c);
+		++row;
+	}
+
+	return PointChunk{ chunk_x.data(), chunk_y.data(), chunk_label.data(), params.is_streaming ? chunk_time.data() : nullptr, chunk_x.size() };
+}
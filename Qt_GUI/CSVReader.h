@@ -0,0 +1,79 @@
+#pragma once
+
+#include <deque>
+#include <future>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "global.h"
+#include "MappedFile.h"
+
+extern Param params;
+
+// reads the "[date,]x,y,label" layout from a memory-mapped csv file chunk by chunk,
+// newline-aligned byte ranges ahead of the current chunk are parsed on the thread pool and consumed in file order
+class CSVReader
+{
+public:
+	struct Row {
+		qint64 time; // seconds since 1970-01-01 UTC
+		double x, y;
+		const char* label_begin;
+		const char* label_end;
+	};
+
+	CSVReader() = default;
+	~CSVReader() { close(); }
+	CSVReader(const CSVReader&) = delete;
+	CSVReader& operator=(const CSVReader&) = delete;
+
+	// throws std::runtime_error if the file cannot be opened
+	void open(const std::string& filename);
+	void close();
+	bool eof() const { return next_byte >= file.size() && blocks.empty() && row == current.x.size(); }
+
+	// returns the next chunk, which is cut by params.chunk_size or by params.time_step in the streaming setting,
+	// the chunk stays valid until the next call
+	PointChunk read(std::unordered_map<uint, std::string>* class2label);
+
+	// parses the row starting at *row* and returns the beginning of the next row,
+	// the date is "yyyy-MM-dd" optionally followed by " HH:mm[:ss]" or "THH:mm[:ss]" in UTC, an invalid one becomes 0
+	static const char* parseRow(const char* row, const char* end, bool with_date, Row* out);
+
+private:
+	// the rows of one byte range
+	struct Block {
+		size_t begin = 0; // file offset of the range
+		std::vector<uint> row_end; // offset of the end of each row, relative to begin
+		std::vector<float> x, y;
+		std::vector<qint64> time;
+		std::vector<uint> label; // index into labels
+		std::vector<std::string> labels; // distinct labels of the range in order of first appearance
+	};
+
+	static Block parseBlock(const char* data, size_t begin, size_t end, bool with_date);
+	// keeps the pool busy with the ranges following the queued ones
+	void submitBlocks();
+	// drops the queued ranges and parses again from the first row not yet handed out
+	void restart();
+	// makes the next queued range current, returns false if the file is exhausted
+	bool nextBlock();
+
+	// maps a label to its class and registers unseen labels in class2label
+	uint classOf(const std::string& label, std::unordered_map<uint, std::string>* class2label);
+
+	MappedFile file;
+	size_t next_byte = 0; // the first byte not yet handed to the pool
+	bool with_date = false; // the layout the queued ranges are parsed with
+	std::deque<std::future<Block>> blocks;
+	Block current;
+	size_t row = 0; // the next row of current
+	std::vector<uint> local2class; // current.labels -> class
+	std::vector<float> chunk_x, chunk_y; // the columns of the last chunk
+	std::vector<uint> chunk_label;
+	std::vector<qint64> chunk_time;
+
+	std::vector<std::string> labels; // class -> label, mirrors class2label
+	uint last_class = 0;
+};
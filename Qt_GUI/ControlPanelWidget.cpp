@@ -37,7 +37,17 @@ ControlPanelWidget::ControlPanelWidget(SamplingProcessViewer* viewer, QWidget* p
 		spin_grid_width->setToolTip(
 			"The width of uniform grid, used in the sampling procedure.");
 		connect(spin_grid_width, QOverload<int>::of(&QSpinBox::valueChanged),
-			[this](int value) { params.grid_width = value; this->viewer->gridWidthChanged(true); });
+			[this](int value) { params.grid_width = value; this->viewer->gridWidthChanged(true); this->viewer->regrid(); });
+
+		QLabel* base_grid_width_label = new QLabel("Base grid width:", this);
+		QSpinBox* spin_base_grid_width = new QSpinBox(this);
+		spin_base_grid_width->setRange(0, 100);
+		spin_base_grid_width->setValue(params.base_grid_width);
+		spin_base_grid_width->setToolTip(
+			"The width of a finer grid kept in a static setting, so that a grid width that is a multiple of it is sampled without reading the data again.\n"
+			"0 keeps none, takes effect when the data is read again.");
+		connect(spin_base_grid_width, QOverload<int>::of(&QSpinBox::valueChanged),
+			[](int value) { params.base_grid_width = value; });
 
 		QLabel* frame_id_label = new QLabel("Frame ID:", this);
 		QSpinBox* spin_frame_id = new QSpinBox(this);
@@ -71,7 +81,7 @@ ControlPanelWidget::ControlPanelWidget(SamplingProcessViewer* viewer, QWidget* p
 		QLabel* step_label = new QLabel("Time step:", this);
 		QSpinBox* spin_step = new QSpinBox(this);
 		spin_step->setToolTip(
-			"The size of time step used in streaming setting, unit is day.");
+			"The size of time step used in streaming setting, the unit is params.time_unit seconds (one day by default).");
 		spin_step->setValue(params.time_step);
 		connect(spin_step, QOverload<int>::of(&QSpinBox::valueChanged),
 			[this](int value) { params.time_step = value;	});
@@ -79,16 +89,33 @@ ControlPanelWidget::ControlPanelWidget(SamplingProcessViewer* viewer, QWidget* p
 		QLabel* window_label = new QLabel("Window size:", this);
 		QSpinBox* spin_window = new QSpinBox(this);
 		spin_window->setToolTip(
-			"The size of time window used in streaming setting, unit is day.");
+			"The size of time window used in streaming setting, the unit is params.time_unit seconds (one day by default).");
 		spin_window->setValue(params.time_window);
 		connect(spin_window, QOverload<int>::of(&QSpinBox::valueChanged),
 			[this](int value) { params.time_window = value;	});
 
+		QLabel* half_life_label = new QLabel("Half-life:", this);
+		QSpinBox* spin_half_life = new QSpinBox(this);
+		spin_half_life->setToolTip(
+			"The number of time steps after which a point counts half in the density of a stream, 0 uses the time window instead, takes effect when the data is read again.");
+		spin_half_life->setValue(params.half_life);
+		connect(spin_half_life, QOverload<int>::of(&QSpinBox::valueChanged),
+			[this](int value) { params.half_life = value;	});
+
 		QCheckBox* streaming_option = new QCheckBox("Streaming data", this);
 		streaming_option->setChecked(params.is_streaming);
 		connect(streaming_option, &QCheckBox::clicked,
 			[this](bool value) { params.is_streaming = value; });
 
+		QCheckBox* class_channels_option = new QCheckBox("Keep classes apart", this);
+		class_channels_option->setToolTip(
+			"Keep the density of every class in a static setting, so that selecting classes samples again without reading the data.\n"
+			"It costs a density map, representatives and reservoirs for every class, 52 bytes per grid cell and class, "
+			"takes effect when the data is read again.");
+		class_channels_option->setChecked(params.class_channels);
+		connect(class_channels_option, &QCheckBox::clicked,
+			[this](bool value) { params.class_channels = value; });
+
 		QLabel* stop_level_label = new QLabel("Stop level:", this);
 		QSpinBox* spin_stop_level = new QSpinBox(this);
 		spin_stop_level->setToolTip(
@@ -96,6 +123,7 @@ ControlPanelWidget::ControlPanelWidget(SamplingProcessViewer* viewer, QWidget* p
 		spin_stop_level->setValue(params.stop_level);
 		connect(spin_stop_level, QOverload<int>::of(&QSpinBox::valueChanged), [this](int value) {
 			params.stop_level = value;
+			this->viewer->resample();
 		});
 
 		QLabel* density_threshold_label = new QLabel("Density threshold:", this);
@@ -106,7 +134,7 @@ ControlPanelWidget::ControlPanelWidget(SamplingProcessViewer* viewer, QWidget* p
 		spin_density_threshold->setRange(0.0, 1.0);
 		spin_density_threshold->setValue(params.density_threshold);
 		connect(spin_density_threshold, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
-			[this](double value) { params.density_threshold = value; });
+			[this](double value) { params.density_threshold = value; this->viewer->resample(); });
 
 		QLabel* outlier_weight_label = new QLabel("Outlier weight:", this);
 		QDoubleSpinBox* spin_outlier_weight = new QDoubleSpinBox(this);
@@ -117,7 +145,7 @@ ControlPanelWidget::ControlPanelWidget(SamplingProcessViewer* viewer, QWidget* p
 		spin_outlier_weight->setSingleStep(0.1);
 		spin_outlier_weight->setValue(params.outlier_weight);
 		connect(spin_outlier_weight, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
-			[this](double value) { params.outlier_weight = value; });
+			[this](double value) { params.outlier_weight = value; this->viewer->resample(); });
 
 		QLabel* eps_label = new QLabel("Ratio threshold:", this);
 		QDoubleSpinBox* spin_eps = new QDoubleSpinBox(this);
@@ -149,7 +177,12 @@ ControlPanelWidget::ControlPanelWidget(SamplingProcessViewer* viewer, QWidget* p
 		algoGroupLayout->addWidget(spin_step, 7, 1);
 		algoGroupLayout->addWidget(window_label, 8, 0);
 		algoGroupLayout->addWidget(spin_window, 8, 1);
-		algoGroupLayout->addWidget(streaming_option, 9, 0, 1, -1);
+		algoGroupLayout->addWidget(half_life_label, 9, 0);
+		algoGroupLayout->addWidget(spin_half_life, 9, 1);
+		algoGroupLayout->addWidget(streaming_option, 10, 0, 1, -1);
+		algoGroupLayout->addWidget(base_grid_width_label, 11, 0);
+		algoGroupLayout->addWidget(spin_base_grid_width, 11, 1);
+		algoGroupLayout->addWidget(class_channels_option, 12, 0, 1, -1);
 
 		layout->addWidget(algorithm_group);
 	}
@@ -205,7 +238,7 @@ ControlPanelWidget::ControlPanelWidget(SamplingProcessViewer* viewer, QWidget* p
 
 	connect(fileButton, &QPushButton::pressed, [this, save_CSV]() {
 		QString path = QFileDialog::getOpenFileName(this, tr("Open Dataset"), QString(),
-			tr("Comma-Separated Values Files (*.csv)"));
+			tr("Comma-Separated Values Files (*.csv);;Point Files (*.pbs)"));
 
 		if (path.isEmpty())
 			return;
@@ -262,7 +295,11 @@ void ControlPanelWidget::addClassSelectionBox(const std::unordered_map<uint, std
 			else {
 				selected_class_order.push_back(pr.first);
 			}
-			this->viewer->redrawPoints();
+			// without the classes kept apart the worker may be busy reading, so the points are redrawn right away
+			if (this->viewer->keepsClasses())
+				this->viewer->reclassify();
+			else
+				this->viewer->redrawPoints();
 			});
 	}
 	class_selection_box->setLayout(vbox);
@@ -0,0 +1,152 @@
+#include "FrameHistory.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+FrameHistory& FrameHistory::operator=(FrameHistory&& other)
+{
+	if (this != &other) {
+		closeSpill();
+		current = move(other.current);
+		frame_num = other.frame_num;
+		keyframes = move(other.keyframes);
+		deltas = move(other.deltas);
+		memory_frames = other.memory_frames;
+		spilled_segments = other.spilled_segments;
+		spill_path = move(other.spill_path);
+		spill_out = move(other.spill_out);
+		spill_offsets = move(other.spill_offsets);
+		spill_map = move(other.spill_map);
+		other.frame_num = other.spilled_segments = 0;
+	}
+	return *this;
+}
+
+void FrameHistory::reset(size_t cell_num, size_t memory_frames, const string& spill_path)
+{
+	closeSpill();
+	current.assign((cell_num + 63) / 64, 0);
+	frame_num = 0;
+	keyframes.clear();
+	deltas.clear();
+	this->memory_frames = memory_frames;
+	this->spill_path = spill_path;
+}
+
+void FrameHistory::push(const vector<uint32_t>& added, const vector<uint32_t>& removed)
+{
+	Delta d{ added, removed };
+	apply(d, &current);
+	if (frame_num % KEYFRAME_INTERVAL == 0) {
+		keyframes.push_back(current);
+		deltas.emplace_back();
+	}
+	else {
+		deltas.push_back(move(d));
+	}
+	++frame_num;
+
+	// a segment leaves memory only when memory_frames newer frames remain
+	while (memory_frames != 0 && (spilled_segments + 1) * KEYFRAME_INTERVAL <= frame_num
+		&& frame_num - (spilled_segments + 1) * KEYFRAME_INTERVAL >= memory_frames)
+		spillSegment();
+}
+
+FrameHistory::Bitmap FrameHistory::frame(size_t id) const
+{
+	size_t key = id / KEYFRAME_INTERVAL;
+	Bitmap result(current.size());
+	if (key < spilled_segments) {
+		readSegment(key, id, &result);
+		return result;
+	}
+	size_t first_frame = spilled_segments * KEYFRAME_INTERVAL;
+	result = keyframes[key - spilled_segments];
+	for (size_t f = key * KEYFRAME_INTERVAL + 1; f <= id; ++f)
+		apply(deltas[f - first_frame], &result);
+	return result;
+}
+
+void FrameHistory::apply(const Delta& d, Bitmap* b)
+{
+	apply(d.added.data(), d.added.size(), true, b);
+	apply(d.removed.data(), d.removed.size(), false, b);
+}
+
+void FrameHistory::apply(const uint32_t* cells, uint32_t n, bool selected, Bitmap* b)
+{
+	for (uint32_t i = 0; i < n; ++i) {
+		uint32_t c = cells[i];
+		if (selected)
+			(*b)[c >> 6] |= 1ull << (c & 63);
+		else
+			(*b)[c >> 6] &= ~(1ull << (c & 63));
+	}
+}
+
+// a spilled segment is the keyframe bitmap followed by, for each following frame, the number of added
+// and removed cells as two uint32 and then the cells themselves
+void FrameHistory::spillSegment()
+{
+	if (!spill_out.is_open()) {
+		spill_out.open(spill_path, ios::binary | ios::trunc);
+		spill_offsets.assign(1, 0);
+	}
+	if (!spill_out)
+		throw runtime_error("cannot write " + spill_path);
+
+	const Bitmap& key = keyframes.front();
+	spill_out.write(reinterpret_cast<const char*>(key.data()), key.size() * sizeof(uint64_t));
+	uint64_t length = key.size() * sizeof(uint64_t);
+	for (size_t f = 1; f < KEYFRAME_INTERVAL; ++f) {
+		const Delta& d = deltas[f];
+		uint32_t counts[2] = { static_cast<uint32_t>(d.added.size()), static_cast<uint32_t>(d.removed.size()) };
+		spill_out.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+		spill_out.write(reinterpret_cast<const char*>(d.added.data()), d.added.size() * sizeof(uint32_t));
+		spill_out.write(reinterpret_cast<const char*>(d.removed.data()), d.removed.size() * sizeof(uint32_t));
+		length += sizeof(counts) + (d.added.size() + d.removed.size()) * sizeof(uint32_t);
+	}
+	spill_out.flush();
+	if (!spill_out)
+		throw runtime_error("cannot write " + spill_path);
+	spill_offsets.push_back(spill_offsets.back() + length);
+
+	keyframes.pop_front();
+	deltas.erase(deltas.begin(), deltas.begin() + KEYFRAME_INTERVAL);
+	++spilled_segments;
+}
+
+void FrameHistory::readSegment(size_t segment, size_t id, Bitmap* b) const
+{
+	if (!spill_map.isOpen() || spill_map.size() < spill_offsets[segment + 1])
+		spill_map.open(spill_path); // the file grew since it was mapped
+	const char* p = spill_map.data() + spill_offsets[segment];
+	memcpy(b->data(), p, b->size() * sizeof(uint64_t));
+	p += b->size() * sizeof(uint64_t);
+
+	vector<uint32_t> cells;
+	for (size_t f = segment * KEYFRAME_INTERVAL + 1; f <= id; ++f) {
+		uint32_t counts[2];
+		memcpy(counts, p, sizeof(counts));
+		p += sizeof(counts);
+		cells.resize(counts[0] + counts[1]);
+		if (!cells.empty()) memcpy(cells.data(), p, cells.size() * sizeof(uint32_t));
+		p += cells.size() * sizeof(uint32_t);
+		apply(cells.data(), counts[0], true, b);
+		apply(cells.data() + counts[0], counts[1], false, b);
+	}
+}
+
+void FrameHistory::closeSpill()
+{
+	spill_map.close();
+	if (spill_out.is_open()) {
+		spill_out.close();
+		remove(spill_path.c_str());
+	}
+	spill_offsets.clear();
+	spilled_segments = 0;
+}
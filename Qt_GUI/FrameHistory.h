@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "MappedFile.h"
+
+// the selected cells of every frame of a sampling run, a full bitmap is kept every KEYFRAME_INTERVAL frames
+// and only the cells added and removed are kept for the frames in between,
+// with a memory limit the oldest keyframes and their deltas are moved to a file and mapped back when asked for
+class FrameHistory
+{
+public:
+	using Bitmap = std::vector<uint64_t>; // one bit per cell
+
+	const static size_t KEYFRAME_INTERVAL = 64;
+
+	FrameHistory() {}
+	FrameHistory(const FrameHistory&) = delete;
+	FrameHistory& operator=(const FrameHistory&) = delete;
+	FrameHistory(FrameHistory&& other) { *this = std::move(other); }
+	FrameHistory& operator=(FrameHistory&& other);
+	~FrameHistory() { closeSpill(); }
+
+	// forgets all frames, the frames to come have cell_num cells, at least memory_frames of the most recent frames
+	// stay in memory and the older ones are written to spill_path, 0 keeps every frame in memory
+	void reset(size_t cell_num, size_t memory_frames = 0, const std::string& spill_path = std::string());
+	bool empty() const { return frame_num == 0; }
+	size_t size() const { return frame_num; }
+
+	// appends a frame given the cells added and removed since the last frame,
+	// throws std::runtime_error if old frames cannot be written to the spill file
+	void push(const std::vector<uint32_t>& added, const std::vector<uint32_t>& removed);
+	// the selected cells of the given frame, rebuilt from the nearest keyframe before it
+	Bitmap frame(size_t id) const;
+	// the selected cells of the last frame
+	const Bitmap& last() const { return current; }
+
+	static bool test(const Bitmap& b, uint32_t cell) { return (b[cell >> 6] >> (cell & 63)) & 1; }
+	// calls f(cell) for the selected cells in ascending order
+	template<class F>
+	static void forEachCell(const Bitmap& b, F f)
+	{
+		for (size_t w = 0; w < b.size(); ++w)
+			for (uint64_t bits = b[w]; bits; bits &= bits - 1)
+				f(static_cast<uint32_t>(w << 6 | countTrailingZeros(bits)));
+	}
+
+private:
+	static int countTrailingZeros(uint64_t bits)
+	{
+#ifdef _MSC_VER
+		unsigned long idx;
+		_BitScanForward64(&idx, bits);
+		return static_cast<int>(idx);
+#else
+		return __builtin_ctzll(bits);
+#endif
+	}
+
+	struct Delta {
+		std::vector<uint32_t> added, removed;
+	};
+	static void apply(const Delta& d, Bitmap* b);
+	static void apply(const uint32_t* cells, uint32_t n, bool selected, Bitmap* b);
+
+	// moves the oldest keyframe in memory and its deltas to the end of the spill file
+	void spillSegment();
+	// rebuilds the frame id of a spilled keyframe segment
+	void readSegment(size_t segment, size_t id, Bitmap* b) const;
+	void closeSpill();
+
+	Bitmap current;
+	size_t frame_num = 0;
+	std::deque<Bitmap> keyframes; // the frames spilled_segments * KEYFRAME_INTERVAL, ... still in memory
+	std::deque<Delta> deltas; // per frame from frame spilled_segments * KEYFRAME_INTERVAL on, empty for the keyframes
+
+	size_t memory_frames = 0;
+	size_t spilled_segments = 0;
+	std::string spill_path;
+	std::ofstream spill_out;
+	std::vector<uint64_t> spill_offsets; // where each spilled segment starts, followed by the end of the file
+	mutable MappedFile spill_map;
+};
@@ -1,50 +1,151 @@
 #include "HierarchicalSampling.h"
 
+#include <QCoreApplication>
+#include <QDir>
+#include <numeric>
+
 using namespace std;
 
 const static vector<uint> power_2 = { 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
 
 chrono::time_point<chrono::steady_clock> start;
 
-HierarchicalSampling::HierarchicalSampling(const QRect& bounding_rect)
+// the number of rows of a level handed to one task of the thread pool, about TILE_CELLS regions
+const static int TILE_CELLS = 4096;
+static size_t rowsPerTask(int cols) { return max(1, TILE_CELLS / max(cols, 1)); }
+// the weight of a point at the decay epoch, and how far the epoch may fall behind before the weights are rescaled
+const static int DECAY_FRACTION_BITS = 16;
+const static int DECAY_REBASE_HALF_LIVES = 16;
+// the pyramids are rebuilt level by level instead of ancestor by ancestor once more than 1/FULL_REBUILD_RATIO of the cells are dirty
+const static size_t FULL_REBUILD_RATIO = 4;
+// a chunk is binned by ranges of cells, about KEY_RANGES_PER_THREAD per thread so that a dense part of the data
+// does not leave the other threads idle, a chunk below MIN_PARALLEL_POINTS is binned by the calling thread
+const static size_t KEY_RANGES_PER_THREAD = 8;
+const static size_t MIN_PARALLEL_POINTS = 1 << 14;
+
+// calls bin(begin, end) with the positions in the chunk of the points whose key lies in one range of [0, key_num),
+// in the order of the chunk, so binning the points one after another gives the serial result for every key,
+// the calls run in parallel and never share a key
+template<class Key, class Bin>
+static void binByKey(size_t n, size_t key_num, Key key, Bin bin)
 {
-	horizontal_bin_num = bounding_rect.width() / params.grid_width + 1;
-	vertical_bin_num = bounding_rect.height() / params.grid_width + 1;
+	ThreadPool& pool = ThreadPool::global();
+	vector<uint> order(n);
+	if (n < MIN_PARALLEL_POINTS || pool.size() == 0 || key_num < 2) {
+		iota(order.begin(), order.end(), 0u);
+		bin(order.data(), order.data() + n);
+		return;
+	}
 
-	elected_points.resize(horizontal_bin_num);
-	index_map.resize(horizontal_bin_num);
-	for (uint i = 0; i < horizontal_bin_num; ++i) {
-		elected_points[i].resize(vertical_bin_num);
-		index_map[i].resize(vertical_bin_num);
+	// a counting sort of the positions by key range, every block of the chunk counts and places its own points
+	const size_t range_num = min(key_num, static_cast<size_t>(pool.size()) * KEY_RANGES_PER_THREAD),
+		block_num = pool.size() + 1, block_size = (n + block_num - 1) / block_num;
+	vector<uint> range_of(n);
+	vector<size_t> offsets(block_num * range_num, 0);
+	pool.parallelFor(block_num, 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; ++b) {
+			size_t* count = &offsets[b * range_num];
+			for (size_t k = b * block_size, last = min(n, k + block_size); k < last; ++k) {
+				range_of[k] = static_cast<uint>(static_cast<uint64_t>(key(k)) * range_num / key_num);
+				++count[range_of[k]];
+			}
+		}
+	});
+	vector<size_t> range_begin(range_num + 1);
+	size_t total = 0;
+	for (size_t r = 0; r < range_num; ++r) {
+		range_begin[r] = total;
+		for (size_t b = 0; b < block_num; ++b) {
+			size_t count = offsets[b * range_num + r];
+			offsets[b * range_num + r] = total;
+			total += count;
+		}
 	}
+	range_begin[range_num] = total;
+	pool.parallelFor(block_num, 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; ++b) {
+			size_t* offset = &offsets[b * range_num];
+			for (size_t k = b * block_size, last = min(n, k + block_size); k < last; ++k)
+				order[offset[range_of[k]]++] = static_cast<uint>(k);
+		}
+	});
+
+	pool.parallelFor(range_num, 1, [&](size_t begin, size_t end) {
+		for (size_t r = begin; r < end; ++r)
+			bin(order.data() + range_begin[r], order.data() + range_begin[r + 1]);
+	});
+}
+
+HierarchicalSampling::HierarchicalSampling(const QRect& bounding_rect) : bounding_rect(bounding_rect)
+{
+	election_seed = static_cast<uint64_t>(gen()) << 32 | gen();
+	allocateGrids();
+}
+
+void HierarchicalSampling::allocateGrids()
+{
+	horizontal_bin_num = binNum(bounding_rect.width());
+	vertical_bin_num = binNum(bounding_rect.height());
+
+	size_t bin_num = static_cast<size_t>(horizontal_bin_num) * vertical_bin_num;
+	elected_points.assign(bin_num, LabeledPoint());
+	elected_ids.assign(bin_num, 0);
+	reservoirs.assign(bin_num, CellReservoir());
 
 	auto start = power_2.begin(), end = power_2.end();
 	max_level = max(lower_bound(start, end, horizontal_bin_num) - start, lower_bound(start, end, vertical_bin_num) - start);
 
-	py.density_map.resize(max_level+1);
-	py.visibility_map.resize(py.density_map.size());
-	py.assignment_map.resize(py.density_map.size());
-	for (uint i = 0; i < py.density_map.size(); ++i) {
-		py.density_map[i] = DensityMap(power_2[i], vector<int>(power_2[i]));
-		py.visibility_map[i] = DensityMap(power_2[i], vector<int>(power_2[i]));
-		py.assignment_map[i] = DensityMap(power_2[i], vector<int>(power_2[i]));
-	}
+	py.resize(max_level, horizontal_bin_num, vertical_bin_num);
+	changed_flags.assign(max_level + 1, vector<uint8_t>());
+	for (int k = 0; k <= max_level; ++k)
+		changed_flags[k].resize(static_cast<size_t>(py.rows(k)) * py.cols(k));
+	dirty_flag.assign(bin_num, 0);
+	current_assignment.resize(bin_num);
+	next_assignment.resize(bin_num);
+}
 
-	uint side_length = power_2[max_level];
-	changed_map.resize(side_length);
-	for (uint i = 0; i < side_length; ++i) {
-		changed_map[i].resize(side_length);
+void Pyramid::resize(int max_level, int rows, int cols)
+{
+	const size_t align = AlignedBuffer<int>::ALIGNMENT / sizeof(int);
+	dims.resize(max_level + 1), offsets.resize(max_level + 1);
+	for (int k = max_level; k >= 0; --k) {
+		dims[k] = make_pair(rows, cols);
+		rows = (rows + 1) / 2, cols = (cols + 1) / 2;
 	}
+	size_t total = 0;
+	for (int k = 0; k <= max_level; ++k) {
+		offsets[k] = total;
+		total += (static_cast<size_t>(dims[k].first) * dims[k].second + align - 1) / align * align;
+	}
+	for (auto& m : maps)
+		m.resize(total);
+}
+
+void Pyramid::clear()
+{
+	for (auto& m : maps)
+		fill(m.data(), m.data() + m.size(), 0);
 }
 
-pair<PointSet, PointSet>* HierarchicalSampling::execute(const FilteredPointSet* origin, bool is_1st)
+pair<PointSet, PointSet>* HierarchicalSampling::execute(const PointStore* origin, bool is_1st)
 {
 	_added.clear(), _removed.clear();
 	if (is_1st) { // is a new dataset
 		last_frame_id = -1;
 
 		initializeGrids();
-		previous_assigned_maps.clear();
+		resetHistory();
+		// the base grid only keeps whole counts, which a stream would have to expire or decay
+		base_width = params.is_streaming ? 0 : params.base_grid_width;
+		base_horizontal_num = base_width == 0 ? 0 : static_cast<uint>(bounding_rect.width()) / base_width + 1;
+		base_vertical_num = base_width == 0 ? 0 : static_cast<uint>(bounding_rect.height()) / base_width + 1;
+		size_t base_num = static_cast<size_t>(base_horizontal_num) * base_vertical_num;
+		base_density.assign(base_num, 0);
+		base_points.assign(base_num, LabeledPoint());
+		base_ids.assign(base_num, 0);
+		base_reservoirs.assign(base_num, CellReservoir());
+		keep_classes = !params.is_streaming && params.class_channels;
+		class_channels.clear();
 	}
 	is_first_frame = is_1st || params.ratio_threshold == 0.0;
 
@@ -54,58 +155,174 @@ pair<PointSet, PointSet>* HierarchicalSampling::execute(const FilteredPointSet*
 	return seeds;
 }
 
-void HierarchicalSampling::constructionHelper(vector<DensityMap>& map_list, int level, int i, int j)
+pair<PointSet, PointSet>* HierarchicalSampling::resample()
 {
-	int i1 = 2 * i, i2 = 2 * i + 1, j1 = 2 * j, j2 = 2 * j + 1;
-	auto &target = map_list[level], &source = map_list[level + 1];
-	target[i][j] = source[i1][j1] + source[i1][j2] + source[i2][j1] + source[i2][j2];
+	if (history.empty()) return nullptr; // nothing was ingested yet
+	start = chrono::high_resolution_clock::now();
+
+	_added.clear(), _removed.clear();
+	// the finest density and visibility maps still hold the last ingest, so only the pyramids and assignment are redone,
+	// without the coherence with the last frame since its result came from the old parameters
+	is_first_frame = true;
+	constructPyramids();
+	generateAssignmentMapsHierarchically();
+	auto seeds = getSeedsDifference();
+	qDebug() << "resampling:" << (double)(chrono::high_resolution_clock::now() - start).count() / 1e9;
+	return seeds;
 }
 
-vector<vector<pair<int, int>>> HierarchicalSampling::classifyRegions(int level, const vector<pair<int, int>>& indices)
+pair<PointSet, PointSet>* HierarchicalSampling::regrid()
 {
-	auto it = max_element(indices.begin(), indices.end(), [this, level](const pair<int, int>& a, const pair<int, int>& b) {
-		return py.getVal(Pyramid::Density, level, a) < py.getVal(Pyramid::Density, level, b);
-	});
-	double threshold = params.density_threshold * py.getVal(Pyramid::Density, level, *it);
-	size_t max_pos = distance(indices.begin(), it);
-	vector<pair<int, int>> low, high;
-	high.push_back(indices[max_pos]);
-	for (size_t i = 0; i < indices.size(); ++i) {
-		if (py.getVal(Pyramid::Density, level, indices[i]) < threshold)
-			low.push_back(indices[i]);
-		else if (i != max_pos)
-			high.push_back(indices[i]);
+	if (history.empty() || base_width == 0 || params.grid_width % base_width != 0) return nullptr; // the data has to be read again
+	start = chrono::high_resolution_clock::now();
+
+	// all points of the old grid are replaced
+	PointSet removed;
+	FrameHistory::forEachCell(history.last(), [&](uint cell) { removed.push_back(elected_points[cell]); });
+
+	allocateGrids();
+	initializeGrids();
+	resetHistory();
+	last_frame_id = -1;
+	class_channels.clear(); // kept at the old grid width
+
+	// a cell of params.grid_width covers ratio x ratio base cells, its representative is the one of a base cell
+	// picked with the probability of its share of the points, like one point drawn from the whole cell
+	int* D = py.level(Pyramid::Density, max_level);
+	const uint ratio = params.grid_width / base_width;
+	for (uint bi = 0; bi < base_horizontal_num; ++bi) {
+		for (uint bj = 0; bj < base_vertical_num; ++bj) {
+			size_t b = static_cast<size_t>(bi) * base_vertical_num + bj;
+			int count = base_density[b];
+			if (count == 0) continue;
+			uint i = bi / ratio, j = bj / ratio, cell = i * vertical_bin_num + j;
+			D[cell] += count;
+			if (double_dist(gen) * D[cell] < count)
+				elect(cell, base_points[b], base_ids[b]);
+			markDirty(cell);
+		}
 	}
-	return vector<vector<pair<int, int>>>{ low, high };
+	for (uint cell : dirty_cells)
+		reservoirs[cell].resume(D[cell], elected_ids[cell], election_seed);
+
+	_added.clear(), _removed.clear();
+	is_first_frame = true;
+	constructPyramids();
+	generateAssignmentMapsHierarchically();
+	auto seeds = getSeedsDifference();
+	seeds->first = move(removed);
+	qDebug() << "regridding:" << (double)(chrono::high_resolution_clock::now() - start).count() / 1e9;
+	return seeds;
 }
 
-void HierarchicalSampling::smoothingHelper(DensityMap& assignment_map, pair<int, int>&& pos_x, pair<int, int>&& pos_y, int level)
+pair<PointSet, PointSet>* HierarchicalSampling::reclassify()
 {
-	pair<int, int> pos_low, pos_high;
-	if (py.getVal(Pyramid::Density, level, pos_x) > py.getVal(Pyramid::Density, level, pos_y))
-		pos_high = move(pos_x), pos_low = move(pos_y);
+	if (history.empty() || class_channels.empty()) return nullptr; // the data has to be read again
+	start = chrono::high_resolution_clock::now();
+
+	const ClassMask mask;
+	vector<uint> selected_classes, toggled_classes;
+	vector<const int*> selected_maps;
+	for (uint c = 0; c < class_channels.size(); ++c) {
+		if (mask.test(c)) {
+			selected_classes.push_back(c);
+			selected_maps.push_back(class_channels[c].density.data());
+		}
+		if (mask.test(c) != channel_mask.test(c))
+			toggled_classes.push_back(c);
+	}
+	channel_mask = mask;
+	const size_t bin_num = static_cast<size_t>(horizontal_bin_num) * vertical_bin_num;
+	AlignedBuffer<int> density(bin_num);
+	sumMaps(selected_maps.data(), static_cast<int>(selected_maps.size()), density.data(), bin_num);
+
+	// the cells with points of a toggled class get a representative of the selected classes, picked with the probability
+	// of the share of its class, the old representatives of those selected in the last frame are removed from the screen,
+	// the total density is no test as a class may be swapped for another one with as many points in the cell
+	int* D = py.level(Pyramid::Density, max_level);
+	auto& last = history.last();
+	vector<uint8_t> changed(bin_num, 0);
+	vector<uint> replaced_cells;
+	PointSet removed, added;
+	for (uint cell = 0; cell < bin_num; ++cell) {
+		bool toggled = false;
+		for (uint c : toggled_classes)
+			toggled |= class_channels[c].density[cell] != 0;
+		if (!toggled) continue;
+		changed[cell] = 1;
+		if (FrameHistory::test(last, cell)) {
+			removed.push_back(elected_points[cell]);
+			replaced_cells.push_back(cell);
+		}
+		D[cell] = density[cell];
+		markDirty(cell);
+		int total = 0;
+		for (uint c : selected_classes) {
+			const ClassChannel& channel = class_channels[c];
+			int count = channel.density[cell];
+			if (count == 0) continue;
+			total += count;
+			if (double_dist(gen) * total < count)
+				elect(cell, channel.points[cell], channel.ids[cell]);
+		}
+		reservoirs[cell].resume(D[cell], elected_ids[cell], election_seed);
+	}
+	base_width = 0; // the base grid only holds the classes selected when the data was read
+
+	_added.clear(), _removed.clear();
+	is_first_frame = true;
+	constructPyramids();
+	generateAssignmentMapsHierarchically();
+	for (uint cell : _removed)
+		if (!changed[cell])
+			removed.push_back(elected_points[cell]);
+	for (uint cell : _added)
+		added.push_back(elected_points[cell]);
+	auto& current = history.last();
+	for (uint cell : replaced_cells)
+		if (FrameHistory::test(current, cell))
+			added.push_back(elected_points[cell]);
+	last_frame_id = history.size() - 1;
+	qDebug() << "reclassifying:" << (double)(chrono::high_resolution_clock::now() - start).count() / 1e9;
+	return new pair<PointSet, PointSet>(move(removed), move(added));
+}
+
+void HierarchicalSampling::resetHistory()
+{
+	// a stream may run for weeks, so only its recent frames are kept in memory
+	string spill_path = QDir::tempPath().toStdString() + "/pbs_history_" + to_string(QCoreApplication::applicationPid())
+		+ "_" + to_string(reinterpret_cast<uintptr_t>(this)) + ".bin";
+	history.reset(static_cast<size_t>(horizontal_bin_num) * vertical_bin_num, params.is_streaming ? params.history_frames : 0, spill_path);
+	selected.reset(static_cast<size_t>(horizontal_bin_num) * vertical_bin_num);
+}
+
+
+void HierarchicalSampling::smoothingHelper(int* assignment_map, int pos_x, int pos_y, int level)
+{
+	const int* D = py.level(Pyramid::Density, level), *V = py.level(Pyramid::Visibility, level);
+	int* A = assignment_map;
+	int pos_low, pos_high;
+	if (D[pos_x] > D[pos_y])
+		pos_high = pos_x, pos_low = pos_y;
 	else
-		pos_high = move(pos_y), pos_low = move(pos_x);
-	if (py.getVal(Pyramid::Density, level, pos_high) > 0) {
-		int density_sum = py.getVal(Pyramid::Density, level, pos_high) + py.getVal(Pyramid::Density, level, pos_low),
-			sample_sum = assignment_map[pos_high.first][pos_high.second] + assignment_map[pos_low.first][pos_low.second];
-		if ((double)py.getVal(Pyramid::Density, level, pos_low) / py.getVal(Pyramid::Density, level, pos_high) > 
-			(double)assignment_map[pos_low.first][pos_low.second] / assignment_map[pos_high.first][pos_high.second]) {
-			assignment_map[pos_high.first][pos_high.second] = min(py.getVal(Pyramid::Visibility, level, pos_high),
-				(int)round(static_cast<double>(sample_sum) * py.getVal(Pyramid::Density, level, pos_high) / density_sum));
-			assignment_map[pos_low.first][pos_low.second] = sample_sum - assignment_map[pos_high.first][pos_high.second];
+		pos_high = pos_y, pos_low = pos_x;
+	if (D[pos_high] > 0) {
+		int density_sum = D[pos_high] + D[pos_low],
+			sample_sum = A[pos_high] + A[pos_low];
+		if ((double)D[pos_low] / D[pos_high] > (double)A[pos_low] / A[pos_high]) {
+			A[pos_high] = min(V[pos_high], (int)round(static_cast<double>(sample_sum) * D[pos_high] / density_sum));
+			A[pos_low] = sample_sum - A[pos_high];
 		}
-		else if (assignment_map[pos_high.first][pos_high.second] < assignment_map[pos_low.first][pos_low.second]) {
-			int visual_sum = py.getVal(Pyramid::Visibility, level, pos_high) + py.getVal(Pyramid::Visibility, level, pos_low);
-			assignment_map[pos_high.first][pos_high.second] = min(py.getVal(Pyramid::Visibility, level, pos_high),
-				(int)round(static_cast<double>(sample_sum) / ((1.0 - params.outlier_weight) * density_sum / py.getVal(Pyramid::Density, level, pos_high)
-					+ params.outlier_weight * visual_sum / py.getVal(Pyramid::Visibility, level, pos_high))));
-			assignment_map[pos_low.first][pos_low.second] = sample_sum - assignment_map[pos_high.first][pos_high.second];
+		else if (A[pos_high] < A[pos_low]) {
+			int visual_sum = V[pos_high] + V[pos_low];
+			A[pos_high] = min(V[pos_high], (int)round(static_cast<double>(sample_sum) / ((1.0 - params.outlier_weight) * density_sum / D[pos_high]
+				+ params.outlier_weight * visual_sum / V[pos_high])));
+			A[pos_low] = sample_sum - A[pos_high];
 		}
 	}
 }
 
-void HierarchicalSampling::adjacentChangedHelper(const DensityMap& assignment_map, pair<int, int>&& pos_x, pair<int, int>&& pos_y, int level)
+int HierarchicalSampling::adjacentChangedHelper(const int* assignment_map, pair<int, int>&& pos_x, pair<int, int>&& pos_y, int level)
 {
 	pair<int, int> pos_changed, pos_unchanged;
 	bool exclusive_changed = false;
@@ -119,61 +336,110 @@ void HierarchicalSampling::adjacentChangedHelper(const DensityMap& assignment_ma
 	}
 
 	if (exclusive_changed) {
-		int D_changed = py.getVal(Pyramid::Density, level, pos_changed), D_unchanged = py.getVal(Pyramid::Density, level, pos_unchanged);
+		int cols = py.cols(level),
+			changed = pos_changed.first * cols + pos_changed.second, unchanged = pos_unchanged.first * cols + pos_unchanged.second;
+		const int* D = py.level(Pyramid::Density, level), *A = py.level(Pyramid::Assignment, level);
+		int D_changed = D[changed], D_unchanged = D[unchanged];
 		if (D_changed > D_unchanged) {
-			if(assignment_map[pos_changed.first][pos_changed.second] > 0 && abs((double)D_unchanged/D_changed -
-				(double)py.getVal(Pyramid::Assignment, level, pos_unchanged) / assignment_map[pos_changed.first][pos_changed.second]) > params.ratio_threshold)
+			if(assignment_map[changed] > 0 && abs((double)D_unchanged/D_changed -
+				(double)A[unchanged] / assignment_map[changed]) > params.ratio_threshold) {
 				setChangedRegion(level, pos_unchanged.first, pos_unchanged.second);
+				return unchanged;
+			}
 		}
 		else {
-			if (assignment_map[pos_unchanged.first][pos_unchanged.second] > 0 && abs((double)D_changed / D_unchanged -
-				(double)assignment_map[pos_changed.first][pos_changed.second] / py.getVal(Pyramid::Assignment, level, pos_unchanged)) > params.ratio_threshold)
+			if (assignment_map[unchanged] > 0 && abs((double)D_changed / D_unchanged -
+				(double)assignment_map[changed] / A[unchanged]) > params.ratio_threshold) {
 				setChangedRegion(level, pos_unchanged.first, pos_unchanged.second);
+				return unchanged;
+			}
 		}
 	}
+	return -1;
 }
 
-bool HierarchicalSampling::detectChangedRegion(int level, const vector<pair<int, int>>& indices)
+bool HierarchicalSampling::detectChangedRegion(int level, int i, int j, const array<int, 4>& indices, int n)
 {
-	int i = indices[0].first >> 1, j = indices[0].second >> 1, k = level - 1;
-	int A_level_1 = py.assignment_map[k][i][j], D_level_1 = py.density_map[k][i][j];
+	int k = level - 1, parent = i * py.cols(k) + j;
+	int A_level_1 = py.level(Pyramid::Assignment, k)[parent], D_level_1 = py.level(Pyramid::Density, k)[parent];
 	if (A_level_1 == 0) return true;
+	const int* D = py.level(Pyramid::Density, level), *A = py.level(Pyramid::Assignment, level);
 	double diff = 0.0;
-	for (size_t i = 0, sz = indices.size(); i < sz; ++i) {
-		diff += abs(static_cast<double>(py.getVal(Pyramid::Density, level, indices[i])) / D_level_1
-			- static_cast<double>(py.getVal(Pyramid::Assignment, level, indices[i])) / A_level_1);
+	for (int i = 0; i < n; ++i) {
+		diff += abs(static_cast<double>(D[indices[i]]) / D_level_1
+			- static_cast<double>(A[indices[i]]) / A_level_1);
 	}
 
-	return diff / 4.0 > params.ratio_threshold;
+	return diff / 4.0 > params.ratio_threshold; // missing children at the odd edges count as unchanged
 }
 
 bool HierarchicalSampling::isChangedRegion(int level, int i, int j)
 {
-	int side = power_2[max_level - level];
-	return changed_map[side * i][side * j];
+	return changed_flags[level][i * py.cols(level) + j] != 0;
 }
 
 void HierarchicalSampling::setChangedRegion(int level, int i, int j)
 {
-	int side = power_2[max_level - level];
-	for (int _i = side * i, i_e = _i + side; _i < i_e; ++_i) {
-		for (int _j = side * j, j_e = _j + side; _j < j_e; ++_j) {
-			changed_map[_i][_j] = true;
+	changed_flags[level][i * py.cols(level) + j] = 1;
+}
+
+void HierarchicalSampling::pushChangedDown(int level)
+{
+	int k = level - 1, rows = py.rows(k), cols = py.cols(k), child_rows = py.rows(level), child_cols = py.cols(level);
+	const uint8_t* parent = changed_flags[k].data();
+	uint8_t* child = changed_flags[level].data();
+	const bool finest = level == max_level;
+	mutex cells_mutex;
+	ThreadPool::global().parallelFor(rows, rowsPerTask(cols), [&](size_t begin, size_t end) {
+		vector<uint> cells;
+		for (int i = begin, i_end = end; i < i_end; ++i) {
+			for (int j = 0; j < cols; ++j) {
+				if (!parent[i * cols + j]) continue;
+				for (int _i = 2 * i; _i < min(2 * i + 2, child_rows); ++_i)
+					for (int _j = 2 * j; _j < min(2 * j + 2, child_cols); ++_j) {
+						child[_i * child_cols + _j] = 1;
+						if (finest) cells.push_back(_i * child_cols + _j);
+					}
+			}
 		}
-	}
+		if (!cells.empty()) {
+			lock_guard<mutex> lock(cells_mutex);
+			changed_cells.insert(changed_cells.end(), cells.begin(), cells.end());
+		}
+	});
 }
 
 void HierarchicalSampling::initializeGrids()
 {
-	for (uint i = 0; i < horizontal_bin_num; ++i)
-		for (uint j = 0; j < vertical_bin_num; ++j) {
-			py.density_map[max_level][i][j] = 0;
-			index_map[i][j].clear();
-			elected_points[i][j] = nullptr;
-		}
+	py.clear();
+	sliding_window.assign(params.time_window + 1, TimeSlot());
+	newest_time = numeric_limits<qint64>::min();
+	decayed_weight.assign(static_cast<size_t>(horizontal_bin_num) * vertical_bin_num, 0);
+	// the weights are only meaningful for the half-life they were added with, so a change applies to the next run
+	half_life = params.half_life;
+	fading_cells.clear();
+	fading_flag.assign(static_cast<size_t>(horizontal_bin_num) * vertical_bin_num, 0);
+	decay_epoch = numeric_limits<qint64>::min();
+	dirty_cells.clear();
+	fill(dirty_flag.begin(), dirty_flag.end(), 0);
+}
+
+void HierarchicalSampling::elect(uint cell, const LabeledPoint& point, uint id)
+{
+	elected_points[cell] = point;
+	elected_ids[cell] = id;
+	selected.setId(cell, id);
+}
+
+void HierarchicalSampling::markDirty(uint cell)
+{
+	if (!dirty_flag[cell]) {
+		dirty_flag[cell] = 1;
+		dirty_cells.push_back(cell);
+	}
 }
 
-void HierarchicalSampling::computeAssignMapsProgressively(const FilteredPointSet* origin)
+void HierarchicalSampling::computeAssignMapsProgressively(const PointStore* origin)
 {
 	convertToDensityMap(origin);
 	start = chrono::high_resolution_clock::now();
@@ -181,253 +447,547 @@ void HierarchicalSampling::computeAssignMapsProgressively(const FilteredPointSet
 	generateAssignmentMapsHierarchically();
 }
 
-void HierarchicalSampling::convertToDensityMap(const FilteredPointSet* origin)
+void HierarchicalSampling::convertToDensityMap(const PointStore* origin)
 {
-	auto &D = py.density_map[max_level], &V = py.visibility_map[max_level], &A = py.assignment_map[max_level];
-	QDate *last_date = nullptr;
-	for (auto& pr : *origin) {
-		auto& p = pr.second;
-		int x = visual2grid(p->pos.x(), MARGIN.left),
-			y = visual2grid(p->pos.y(), MARGIN.top);
-		if (D[x][y] == 0) {
-			elected_points[x][y] = make_unique<LabeledPoint>(p);
-			index_map[x][y][p->label] = pr.first;
-		}
-		else if (double_dist(gen) < 0.1) {
-			elected_points[x][y]->pos = p->pos;
-			elected_points[x][y]->label = p->label;
-			index_map[x][y][p->label] = pr.first;
-		}
-		++D[x][y];
-
-		if (params.is_streaming) {
-			if (sliding_window.find(*p->date) == sliding_window.end())
-				sliding_window.emplace(*p->date, DensityMap(horizontal_bin_num, vector<int>(vertical_bin_num)));
-			++sliding_window[*p->date][x][y];
-			if (last_date == nullptr || *last_date < *p->date)
-				last_date = p->date.get(); // find the last date
-		}
+	int* D = py.level(Pyramid::Density, max_level);
+	vector<pair<qint64, uint>> overflow; // points whose slot still holds an older time, which expires below
+	vector<TimeSlot*> touched;
+	const bool decaying = params.is_streaming && half_life > 0;
+	const qint64 last_newest_time = newest_time;
+	const ClassMask selected_classes;
+	const size_t n = origin->size(), bin_num = static_cast<size_t>(horizontal_bin_num) * vertical_bin_num;
+
+	if (keep_classes) {
+		channel_mask = selected_classes;
+		size_t label_num = class_channels.size();
+		for (uint label : origin->label)
+			label_num = max<size_t>(label_num, label + 1);
+		while (class_channels.size() < label_num)
+			class_channels.emplace_back(bin_num);
+		binByKey(n, label_num * bin_num, [origin, bin_num](size_t k) { return origin->label[k] * bin_num + origin->cell[k]; },
+			[&](const uint* begin, const uint* end) {
+			for (const uint* it = begin; it != end; ++it) {
+				uint k = *it, cell = origin->cell[k];
+				ClassChannel& channel = class_channels[origin->label[k]];
+				++channel.density[cell];
+				if (channel.reservoirs[cell].offer(origin->id[k], election_seed)) {
+					channel.points[cell] = origin->at(k);
+					channel.ids[cell] = origin->id[k];
+				}
+			}
+		});
 	}
-	if (params.is_streaming) {
-		for (auto it = sliding_window.begin(); it != sliding_window.end();) {
-			if (it->first.daysTo(*last_date) > params.time_window) {
-				for (size_t i = 0; i < horizontal_bin_num; ++i)
-					for (size_t j = 0; j < vertical_bin_num; ++j)
-						D[i][j] -= it->second[i][j];
-				it = sliding_window.erase(it);
+
+	mutex dirty_mutex;
+	binByKey(n, bin_num, [origin](size_t k) { return origin->cell[k]; }, [&](const uint* begin, const uint* end) {
+		vector<uint> dirty; // the cells belong to this range only, so their dirty flags are not shared
+		for (const uint* it = begin; it != end; ++it) {
+			uint k = *it, label = origin->label[k], cell = origin->cell[k];
+			if (keep_classes && !selected_classes.test(label)) continue;
+			if (D[cell] == 0) // the points left the time window or faded out
+				reservoirs[cell].clear();
+			if (reservoirs[cell].offer(origin->id[k], election_seed))
+				elect(cell, origin->at(k), origin->id[k]);
+			++D[cell];
+			if (!dirty_flag[cell]) {
+				dirty_flag[cell] = 1;
+				dirty.push_back(cell);
 			}
-			else
-				++it;
 		}
+		lock_guard<mutex> lock(dirty_mutex);
+		dirty_cells.insert(dirty_cells.end(), dirty.begin(), dirty.end());
+	});
+
+	if (base_width != 0) {
+		auto base_cell = [this, origin](size_t k) {
+			return static_cast<size_t>(static_cast<int>(origin->x[k] - static_cast<float>(bounding_rect.left())) / base_width) * base_vertical_num
+				+ static_cast<int>(origin->y[k] - static_cast<float>(bounding_rect.top())) / base_width;
+		};
+		binByKey(n, base_density.size(), base_cell, [&](const uint* begin, const uint* end) {
+			for (const uint* it = begin; it != end; ++it) {
+				uint k = *it;
+				if (keep_classes && !selected_classes.test(origin->label[k])) continue;
+				size_t b = base_cell(k);
+				++base_density[b];
+				if (base_reservoirs[b].offer(origin->id[k], election_seed)) {
+					base_points[b] = origin->at(k);
+					base_ids[b] = origin->id[k];
+				}
+			}
+		});
 	}
-	
-	for (uint i = 0; i < power_2[max_level]; ++i) {
-		for (uint j = 0; j < power_2[max_level]; ++j) {
-			if (i < horizontal_bin_num && j < vertical_bin_num) {
-				V[i][j] = (D[i][j] == 0) ? 0 : 1;
+
+	// the time slots are shared by the cells, so the bookkeeping of a stream stays serial
+	if (params.is_streaming && !decaying)
+		resizeSlidingWindow();
+	for (size_t k = 0; k < n && params.is_streaming; ++k) {
+		uint cell = origin->cell[k];
+		qint64 time = origin->time[k];
+		if (decaying) {
+			addDecayed(cell, time);
+		}
+		else {
+			TimeSlot& slot = timeSlot(time);
+			if (slot.isFree() || slot.time == time) {
+				if (slot.pending.empty()) touched.push_back(&slot);
+				slot.time = time;
+				slot.pending.push_back(cell);
 			}
 			else {
-				D[i][j] = V[i][j] = 0;
+				overflow.emplace_back(time, cell);
 			}
-			A[i][j] = is_first_frame ? 0 : previous_assigned_maps.back()[i][j];
-			changed_map[i][j] = is_first_frame;
 		}
+		newest_time = max(newest_time, time); // find the last time
+	}
+	if (decaying) {
+		// the density of every cell fades when the stream moves on
+		updateDecayedDensity(newest_time != last_newest_time);
+	}
+	else if (params.is_streaming) {
+		for (TimeSlot& slot : sliding_window)
+			if (!slot.isFree() && newest_time - slot.time > params.time_window)
+				expireTimeSlot(&slot);
+		for (auto& p : overflow) {
+			TimeSlot& slot = timeSlot(p.first);
+			// the ring holds params.time_window + 1 consecutive times, so the slot of a time in the window holds no other one
+			if (newest_time - p.first > params.time_window) { // already out of the window
+				--D[p.second];
+				markDirty(p.second);
+				continue;
+			}
+			if (slot.pending.empty()) touched.push_back(&slot);
+			slot.time = p.first;
+			slot.pending.push_back(p.second);
+		}
+		for (TimeSlot* slot : touched)
+			slot->merge();
 	}
 }
 
-void HierarchicalSampling::constructPyramids()
+void HierarchicalSampling::addDecayed(uint cell, qint64 time)
 {
-	for (int k = max_level; k > 0;) {
-		--k;
-		
-		for (int i = 0; i < power_2[k]; ++i) {
-			for (int j = 0; j < power_2[k]; ++j) {
-				constructionHelper(py.density_map, k, i, j);
-				constructionHelper(py.visibility_map, k, i, j);
-				if (!is_first_frame)
-					constructionHelper(py.assignment_map, k, i, j);
+	if (decay_epoch == numeric_limits<qint64>::min())
+		decay_epoch = time;
+	qint64 half_lives = (time - decay_epoch) / half_life;
+	if (half_lives >= DECAY_REBASE_HALF_LIVES) { // move the epoch by whole half-lives, which halves the weights exactly
+		for (auto& w : decayed_weight)
+			w = half_lives < 64 ? w >> half_lives : 0;
+		decay_epoch += half_lives * half_life;
+	}
+	if (!fading_flag[cell]) {
+		fading_flag[cell] = 1;
+		fading_cells.push_back(cell);
+	}
+	decayed_weight[cell] += static_cast<uint64_t>(ldexp(1.0, DECAY_FRACTION_BITS) * exp2(static_cast<double>(time - decay_epoch) / half_life) + 0.5);
+}
+
+void HierarchicalSampling::updateDecayedDensity(bool all_cells)
+{
+	int* D = py.level(Pyramid::Density, max_level);
+	const double scale = exp2(-static_cast<double>(newest_time - decay_epoch) / half_life - DECAY_FRACTION_BITS);
+	auto update = [&](uint cell) {
+		int density = static_cast<int>(decayed_weight[cell] * scale + 0.5); // a single point stays for one half-life
+		if (density != D[cell]) {
+			D[cell] = density;
+			markDirty(cell);
+		}
+	};
+	if (all_cells) {
+		// the density never grows without new points, so a cell whose density reached 0 is left out until it gets one
+		for (size_t i = 0; i < fading_cells.size(); ) {
+			uint cell = fading_cells[i];
+			update(cell);
+			if (D[cell] != 0) {
+				++i;
+				continue;
 			}
+			fading_flag[cell] = 0;
+			fading_cells[i] = fading_cells.back();
+			fading_cells.pop_back();
 		}
+	}
+	else { // only the cells of this chunk got new points, they are all dirty already
+		for (size_t i = 0, n = dirty_cells.size(); i < n; ++i)
+			update(dirty_cells[i]);
+	}
+}
 
+void HierarchicalSampling::resizeSlidingWindow()
+{
+	size_t size = static_cast<size_t>(params.time_window) + 1;
+	if (sliding_window.size() == size) return;
+	vector<TimeSlot> kept;
+	for (TimeSlot& slot : sliding_window) {
+		if (slot.isFree()) continue;
+		if (newest_time - slot.time > params.time_window)
+			expireTimeSlot(&slot);
+		else
+			kept.push_back(move(slot));
 	}
+	sliding_window.assign(size, TimeSlot());
+	for (TimeSlot& slot : kept)
+		timeSlot(slot.time) = move(slot);
 }
 
-void HierarchicalSampling::generateAssignmentMapsHierarchically()
+TimeSlot& HierarchicalSampling::timeSlot(qint64 time)
 {
-	int k;
-	DensityMap current_assignment_map = py.visibility_map[0];
-	for (int level = 0; level < max_level; ) {
-		k = level++;
-		DensityMap A(power_2[level], vector<int>(power_2[level]));
+	qint64 n = sliding_window.size(), i = time % n;
+	return sliding_window[i < 0 ? i + n : i];
+}
 
-		for (int j = 0; j < power_2[k]; ++j) {
-			for (int i = 0; i < power_2[k]; ++i) {
-				if (current_assignment_map[i][j] == 0) { // when the sample budget is zero, we can skip the computation of this region
-					continue;
-				}
+void HierarchicalSampling::expireTimeSlot(TimeSlot* slot)
+{
+	int* D = py.level(Pyramid::Density, max_level);
+	slot->merge();
+	for (auto& inc : slot->increments) {
+		D[inc.first] -= inc.second;
+		markDirty(inc.first);
+	}
+	slot->clear();
+}
 
-				int actual_density = py.density_map[k][i][j],
-					visual_pixels = py.visibility_map[k][i][j],
-					point_samples = current_assignment_map[i][j];
+bool CellReservoir::offer(uint id, uint64_t seed)
+{
+	if (seen == 0) { // the first point is kept and sets the first key
+		seen = 1;
+		w = static_cast<float>(1.0 - hashUniform(id, seed));
+		skip(id, seed);
+		return true;
+	}
+	if (++seen != next)
+		return false;
+	w *= static_cast<float>(1.0 - hashUniform(id, seed));
+	skip(id, seed);
+	return true;
+}
 
-				int i1 = 2 * i, i2 = 2 * i + 1, j1 = 2 * j, j2 = 2 * j + 1;
-				vector<pair<int, int>> indices = { { i1,j1 },{ i2,j1 },{ i1,j2 },{ i2,j2 } };
-				bool changed = (!is_first_frame && !isChangedRegion(k, i, j)) && detectChangedRegion(level, indices); // find regions with the difference of density ratios exceeds 
+void CellReservoir::resume(uint32_t count, uint id, uint64_t seed)
+{
+	if (count == 0) {
+		clear();
+		return;
+	}
+	// the smallest of count uniform keys
+	seen = count;
+	w = static_cast<float>(1.0 - pow(1.0 - hashUniform(id, seed), 1.0 / count));
+	skip(id, seed);
+}
 
-				if (level < params.stop_level) {
-					// ClassifyRegions
-					auto low_high_pair = classifyRegions(level, indices);
-					vector<pair<int, int>> low_density_indices = low_high_pair[0], high_density_indices = low_high_pair[1];
+void CellReservoir::skip(uint id, uint64_t seed)
+{
+	// floor(log(u) / log(1 - w)) points are passed over, a w rounded to 0 or a huge skip never replaces again
+	double u = 1.0 - hashUniform(id, ~seed), n = floor(log(u) / log1p(-static_cast<double>(w)));
+	const double limit = numeric_limits<uint32_t>::max() - static_cast<double>(seen) - 1;
+	next = seen + 1 + static_cast<uint32_t>(n >= 0 && n < limit ? n : (n >= 0 ? limit : 0));
+}
 
-					// AssignToHighDensityRegions
-					int& max_assigned_val = A[high_density_indices[0].first][high_density_indices[0].second];
-					max_assigned_val = (int)ceil((double)py.getVal(Pyramid::Visibility, level, high_density_indices[0]) * point_samples / visual_pixels);
+const uint SelectedCells::NONE;
 
-					double sampling_ratio = static_cast<double>(max_assigned_val) / py.getVal(Pyramid::Density, level, high_density_indices[0]);
-					int remain_pixels = point_samples - max_assigned_val;
-					for (size_t _i = 1, sz = high_density_indices.size(); _i < sz && remain_pixels > 0; ++_i) {
-						int density_val = py.getVal(Pyramid::Density, level, high_density_indices[_i]);
-						if (density_val == 0) break; // an empty area can only lead to useless calculation
+void TimeSlot::merge()
+{
+	if (pending.empty()) return;
+	sort(pending.begin(), pending.end());
+	vector<pair<uint, int>> merged;
+	merged.reserve(increments.size() + pending.size());
+	auto it = increments.begin();
+	for (size_t k = 0, sz = pending.size(); k < sz;) {
+		uint cell = pending[k];
+		int count = 0;
+		for (; k < sz && pending[k] == cell; ++k) ++count;
+		for (; it != increments.end() && it->first < cell; ++it) merged.push_back(*it);
+		if (it != increments.end() && it->first == cell) count += (it++)->second;
+		merged.emplace_back(cell, count);
+	}
+	merged.insert(merged.end(), it, increments.end());
+	increments.swap(merged);
+	pending.clear();
+}
 
-						int assigned_val = round(sampling_ratio * density_val);
-						assigned_val = min({ assigned_val, py.getVal(Pyramid::Visibility, level, high_density_indices[_i]), remain_pixels });
-						A[high_density_indices[_i].first][high_density_indices[_i].second] = assigned_val;
+void TimeSlot::clear()
+{
+	time = numeric_limits<qint64>::min();
+	increments.clear();
+	pending.clear();
+}
 
-						remain_pixels -= assigned_val;
-					}
+void HierarchicalSampling::constructPyramids()
+{
+	if (params.is_streaming)
+		updated_cells.assign(dirty_cells.begin(), dirty_cells.end()); // where a point may have left the window
+	int* D = py.level(Pyramid::Density, max_level), *V = py.level(Pyramid::Visibility, max_level);
+	for (uint cell : dirty_cells) {
+		V[cell] = (D[cell] == 0) ? 0 : 1;
+		dirty_flag[cell] = 0;
+	}
 
-					// AssignToLowDensityRegions
-					if (!low_density_indices.empty()) {
-						int low_density_sum = 0, high_density_sum = 0, low_visual_sum = 0, high_visual_sum = 0, high_assigned = 0;
-						for (auto& idx : low_density_indices) {
-							low_density_sum += py.getVal(Pyramid::Density, level, idx);
-							low_visual_sum += py.getVal(Pyramid::Visibility, level, idx);
-						}
-						if (low_density_sum != 0) {
-							high_density_sum = actual_density - low_density_sum;
-							high_visual_sum = visual_pixels - low_visual_sum;
-
-							for (auto& idx : high_density_indices) {
-								high_assigned += A[idx.first][idx.second];
-							}
-							int low_assigned = round(high_assigned * ((1.0 - params.outlier_weight) * low_density_sum / high_density_sum + params.outlier_weight * low_visual_sum / high_visual_sum));
-							for (size_t _i = 0, sz = low_density_indices.size(); _i < sz; ++_i) {
-								int assigned_val = ceil(static_cast<double>(py.getVal(Pyramid::Visibility, level, low_density_indices[_i])) * low_assigned / low_visual_sum);
-								int& ref2map = A[low_density_indices[_i].first][low_density_indices[_i].second];
-								ref2map = max(assigned_val, ref2map); // ensure low density region has more points
-							}
-						}
-					}
-				}
-				else {
-					// AssignDirectly
-					sort(indices.begin(), indices.end(), [this, level](const pair<int, int>& a, const pair<int, int>& b) {
-						return py.getVal(Pyramid::Density, level, a) > py.getVal(Pyramid::Density, level, b);
-					});
-					int remain_assigned_point_num = point_samples;
-					for (size_t _i = 0, sz = indices.size(); _i < sz && remain_assigned_point_num > 0; ++_i) {
-						int assigned_val = ceil((double)point_samples * py.getVal(Pyramid::Visibility, level, indices[_i]) / visual_pixels);
-						assigned_val = min({ assigned_val, py.getVal(Pyramid::Visibility, level, indices[_i]), remain_assigned_point_num });
-						A[indices[_i].first][indices[_i].second] = assigned_val;
-
-						remain_assigned_point_num -= assigned_val;
+	const Pyramid::MapType types[] = { Pyramid::Density, Pyramid::Visibility, Pyramid::Assignment };
+	if (dirty_cells.size() * FULL_REBUILD_RATIO > static_cast<size_t>(horizontal_bin_num) * vertical_bin_num) {
+		const int* children[3];
+		int* parents[3];
+		for (int k = max_level; k > 0;) {
+			--k;
+			for (int m = 0; m < 3; ++m) {
+				children[m] = py.level(types[m], k + 1);
+				parents[m] = py.level(types[m], k);
+			}
+			reduce2x2(children, parents, 3, py.rows(k + 1), py.cols(k + 1));
+		}
+	}
+	else {
+		// only the ancestors of the dirty cells are summed again
+		vector<uint>& cells = dirty_cells;
+		for (int k = max_level; k > 0;) {
+			--k;
+			uint child_rows = py.rows(k + 1), child_cols = py.cols(k + 1), cols = py.cols(k);
+			for (uint& c : cells)
+				c = c / child_cols / 2 * cols + c % child_cols / 2;
+			sort(cells.begin(), cells.end());
+			cells.erase(unique(cells.begin(), cells.end()), cells.end());
+			for (Pyramid::MapType t : types) {
+				const int* child = py.level(t, k + 1);
+				int* parent = py.level(t, k);
+				for (uint c : cells) {
+					uint i1 = c / cols * 2, j1 = c % cols * 2;
+					const int* row1 = child + i1 * child_cols;
+					int sum = row1[j1];
+					if (j1 + 1 < child_cols) sum += row1[j1 + 1];
+					if (i1 + 1 < child_rows) {
+						const int* row2 = row1 + child_cols;
+						sum += row2[j1];
+						if (j1 + 1 < child_cols) sum += row2[j1 + 1];
 					}
+					parent[c] = sum;
 				}
-
-				if (changed)
-					setChangedRegion(k, i, j);
 			}
 		}
+	}
+	dirty_cells.clear();
+}
 
-		if (level > 1) { // RefineBoundary
-			int end = power_2[k] - 1;
+void HierarchicalSampling::assignRegion(int level, int i, int j, const ChildRanks& ranks, int* A)
+{
+	int k = level - 1, cols = py.cols(k), child_rows = py.rows(level), child_cols = py.cols(level);
+	const int* D = py.level(Pyramid::Density, level), *V = py.level(Pyramid::Visibility, level);
+	const int* parent_D = py.level(Pyramid::Density, k), *parent_V = py.level(Pyramid::Visibility, k);
+	int point_samples = current_assignment[i * cols + j];
+	if (point_samples == 0) { // when the sample budget is zero, we can skip the computation of this region
+		return;
+	}
 
-			// Local Region Update
-			for (int j = 0; j < power_2[k]; ++j) {
-				for (int i = 0; i < end; ++i) {
-					int i1 = 2 * i + 1, i2 = 2 * i + 2, j1 = 2 * j, j2 = 2 * j + 1;
-					smoothingHelper(A, make_pair(i1, j1), make_pair(i2, j1), level);
-					smoothingHelper(A, make_pair(i1, j2), make_pair(i2, j2), level);
+	int actual_density = parent_D[i * cols + j],
+		visual_pixels = parent_V[i * cols + j];
+
+	// the existing children in the order (i1, j1), (i2, j1), (i1, j2), (i2, j2)
+	int i1 = 2 * i, i2 = 2 * i + 1, j1 = 2 * j, j2 = 2 * j + 1, n = 0;
+	array<int, 4> indices;
+	indices[n++] = i1 * child_cols + j1;
+	if (i2 < child_rows) indices[n++] = i2 * child_cols + j1;
+	if (j2 < child_cols) {
+		indices[n++] = i1 * child_cols + j2;
+		if (i2 < child_rows) indices[n++] = i2 * child_cols + j2;
+	}
+	bool changed = (!is_first_frame && !isChangedRegion(k, i, j)) && detectChangedRegion(level, i, j, indices, n); // find regions with the difference of density ratios exceeds 
+	auto child = [=](int c) { return (i1 + (c & 1)) * child_cols + j1 + (c >> 1); }; // the position of child c of ChildRanks
+
+	if (level < params.stop_level) {
+		// ClassifyRegions, the densest child comes first and the other high density ones follow in the child order
+		const int top = child(ranks.order[0]);
+		const int high_mask = ranks.child_mask & ~ranks.low_mask & ~(1 << ranks.order[0]);
+
+		// AssignToHighDensityRegions
+		int& max_assigned_val = A[top];
+		max_assigned_val = (int)ceil((double)V[top] * point_samples / visual_pixels);
+
+		double sampling_ratio = static_cast<double>(max_assigned_val) / D[top];
+		int remain_pixels = point_samples - max_assigned_val;
+		for (int c = 0; c < 4 && remain_pixels > 0; ++c) {
+			if (!(high_mask >> c & 1)) continue;
+			int idx = child(c), density_val = D[idx];
+			if (density_val == 0) break; // an empty area can only lead to useless calculation
+
+			int assigned_val = round(sampling_ratio * density_val);
+			assigned_val = min({ assigned_val, V[idx], remain_pixels });
+			A[idx] = assigned_val;
+
+			remain_pixels -= assigned_val;
+		}
+
+		// AssignToLowDensityRegions
+		if (ranks.low_mask) {
+			int low_density_sum = 0, high_density_sum = 0, low_visual_sum = 0, high_visual_sum = 0, high_assigned = A[top];
+			for (int c = 0; c < 4; ++c) {
+				if (ranks.low_mask >> c & 1) {
+					low_density_sum += D[child(c)];
+					low_visual_sum += V[child(c)];
 				}
 			}
-			for (int j = 0; j < end; ++j) {
-				for (int i = 0; i < power_2[k]; ++i) {
-					int i1 = 2 * i, i2 = 2 * i + 1, j1 = 2 * j + 1, j2 = 2 * j + 2;
-					smoothingHelper(A, make_pair(i1, j1), make_pair(i1, j2), level);
-					smoothingHelper(A, make_pair(i2, j1), make_pair(i2, j2), level);
+			if (low_density_sum != 0) {
+				high_density_sum = actual_density - low_density_sum;
+				high_visual_sum = visual_pixels - low_visual_sum;
+
+				for (int c = 0; c < 4; ++c)
+					if (high_mask >> c & 1) high_assigned += A[child(c)];
+				int low_assigned = round(high_assigned * ((1.0 - params.outlier_weight) * low_density_sum / high_density_sum + params.outlier_weight * low_visual_sum / high_visual_sum));
+				for (int c = 0; c < 4; ++c) {
+					if (!(ranks.low_mask >> c & 1)) continue;
+					int assigned_val = ceil(static_cast<double>(V[child(c)]) * low_assigned / low_visual_sum);
+					int& ref2map = A[child(c)];
+					ref2map = max(assigned_val, ref2map); // ensure low density region has more points
 				}
 			}
+		}
+	}
+	else {
+		// AssignDirectly, the children by decreasing density
+		int remain_assigned_point_num = point_samples;
+		for (int _i = 0; _i < n && remain_assigned_point_num > 0; ++_i) {
+			int idx = child(ranks.order[_i]);
+			int assigned_val = ceil((double)point_samples * V[idx] / visual_pixels);
+			assigned_val = min({ assigned_val, V[idx], remain_assigned_point_num });
+			A[idx] = assigned_val;
 
-			// Adjacent Region Refinement
-			if (!is_first_frame) {
-				for (int j = 0; j < power_2[k]; ++j) {
-					for (int i = 0; i < end; ++i) {
+			remain_assigned_point_num -= assigned_val;
+		}
+	}
+
+	if (changed)
+		setChangedRegion(k, i, j);
+}
+
+void HierarchicalSampling::generateAssignmentMapsHierarchically()
+{
+	// the finest flags were cleared by the diff loop of the last frame, nothing is marked in a first frame
+	for (int level = 0; level < max_level; ++level)
+		fill(changed_flags[level].begin(), changed_flags[level].end(), 0);
+
+	ThreadPool& pool = ThreadPool::global();
+	int k;
+	current_assignment[0] = py.level(Pyramid::Visibility, 0)[0];
+	for (int level = 0; level < max_level; ) {
+		k = level++;
+		int rows = py.rows(k), cols = py.cols(k), child_rows = py.rows(level), child_cols = py.cols(level);
+		int* A = next_assignment.data();
+		fill(A, A + child_rows * child_cols, 0);
+
+		// a region only writes its own children and changed flags, so the regions are assigned in tiles of rows,
+		// the children of a whole row of regions are ranked at once before they are assigned
+		const int* child_D = py.level(Pyramid::Density, level);
+		pool.parallelFor(rows, rowsPerTask(cols), [&](size_t begin, size_t end) {
+			vector<ChildRanks> ranks(cols);
+			for (int i = begin, i_end = end; i < i_end; ++i) {
+				const int* row1 = child_D + 2 * i * child_cols;
+				rankChildren(row1, 2 * i + 1 < child_rows ? row1 + child_cols : nullptr, child_cols, params.density_threshold, ranks.data());
+				for (int j = 0; j < cols; ++j)
+					assignRegion(level, i, j, ranks[j], A);
+			}
+		});
+		if (!is_first_frame)
+			pushChangedDown(level);
+
+		if (level > 1) { // RefineBoundary
+			// the boundaries between siblings of different parents, a pair with a missing child at the odd edges is skipped,
+			// no region is in two pairs of the same pass, so every pass runs in tiles of rows and gives the serial result
+			int row_end = (child_rows - 1) / 2, col_end = (child_cols - 1) / 2;
+
+			// Local Region Update
+			pool.parallelFor(row_end, rowsPerTask(cols), [&](size_t begin, size_t end) {
+				for (int i = begin, i_end = end; i < i_end; ++i) {
+					for (int j = 0; j < cols; ++j) {
 						int i1 = 2 * i + 1, i2 = 2 * i + 2, j1 = 2 * j, j2 = 2 * j + 1;
-						adjacentChangedHelper(A, make_pair(i1, j1), make_pair(i2, j1), level);
-						adjacentChangedHelper(A, make_pair(i1, j2), make_pair(i2, j2), level);
+						smoothingHelper(A, i1 * child_cols + j1, i2 * child_cols + j1, level);
+						if (j2 < child_cols) smoothingHelper(A, i1 * child_cols + j2, i2 * child_cols + j2, level);
 					}
 				}
-				for (int j = 0; j < end; ++j) {
-					for (int i = 0; i < power_2[k]; ++i) {
+			});
+			pool.parallelFor(rows, rowsPerTask(col_end), [&](size_t begin, size_t end) {
+				for (int i = begin, i_end = end; i < i_end; ++i) {
+					for (int j = 0; j < col_end; ++j) {
 						int i1 = 2 * i, i2 = 2 * i + 1, j1 = 2 * j + 1, j2 = 2 * j + 2;
-						adjacentChangedHelper(A, make_pair(i1, j1), make_pair(i1, j2), level);
-						adjacentChangedHelper(A, make_pair(i2, j1), make_pair(i2, j2), level);
+						smoothingHelper(A, i1 * child_cols + j1, i1 * child_cols + j2, level);
+						if (i2 < child_rows) smoothingHelper(A, i2 * child_cols + j1, i2 * child_cols + j2, level);
 					}
 				}
+			});
+
+			// Adjacent Region Refinement
+			if (!is_first_frame) {
+				// a region is only marked when it was unchanged, so the finest ones are listed once
+				mutex cells_mutex;
+				auto list = [&](vector<uint>& cells) {
+					if (level != max_level || cells.empty()) return;
+					lock_guard<mutex> lock(cells_mutex);
+					changed_cells.insert(changed_cells.end(), cells.begin(), cells.end());
+				};
+				auto mark = [](vector<uint>& cells, int idx) { if (idx >= 0) cells.push_back(idx); };
+				pool.parallelFor(row_end, rowsPerTask(cols), [&](size_t begin, size_t end) {
+					vector<uint> cells;
+					for (int i = begin, i_end = end; i < i_end; ++i) {
+						for (int j = 0; j < cols; ++j) {
+							int i1 = 2 * i + 1, i2 = 2 * i + 2, j1 = 2 * j, j2 = 2 * j + 1;
+							mark(cells, adjacentChangedHelper(A, make_pair(i1, j1), make_pair(i2, j1), level));
+							if (j2 < child_cols) mark(cells, adjacentChangedHelper(A, make_pair(i1, j2), make_pair(i2, j2), level));
+						}
+					}
+					list(cells);
+				});
+				pool.parallelFor(rows, rowsPerTask(col_end), [&](size_t begin, size_t end) {
+					vector<uint> cells;
+					for (int i = begin, i_end = end; i < i_end; ++i) {
+						for (int j = 0; j < col_end; ++j) {
+							int i1 = 2 * i, i2 = 2 * i + 1, j1 = 2 * j + 1, j2 = 2 * j + 2;
+							mark(cells, adjacentChangedHelper(A, make_pair(i1, j1), make_pair(i1, j2), level));
+							if (i2 < child_rows) mark(cells, adjacentChangedHelper(A, make_pair(i2, j1), make_pair(i2, j2), level));
+						}
+					}
+					list(cells);
+				});
 			}
 		}
-		current_assignment_map = move(A);
+		swap(current_assignment, next_assignment);
 	}
 
-	int point_num = 0;
-	if (previous_assigned_maps.empty()) {
-		for (uint j = 0; j < vertical_bin_num; ++j) {
-			for (uint i = 0; i < horizontal_bin_num; ++i) {
-				if (current_assignment_map[i][j] != 0) {
-					_added.push_back(make_pair(i, j));
-					++point_num;
-				}
-			}
+	// the finest assignment pyramid still holds the result of the last frame and follows the new one,
+	// the ancestors are updated with the next frame
+	int* A = py.level(Pyramid::Assignment, max_level);
+	const int* current = current_assignment.data(), *V = py.level(Pyramid::Visibility, max_level);
+	auto assign = [&](uint idx, int val) {
+		if (A[idx] == val) return;
+		if (val == 0) {
+			_removed.push_back(idx);
+			selected.erase(idx);
+		}
+		else if (A[idx] == 0) {
+			_added.push_back(idx);
+			selected.insert(idx, elected_ids[idx]);
+		}
+		A[idx] = val;
+		markDirty(idx);
+	};
+	const bool leaving = params.is_streaming && !history.empty(); // forcely remove points out of the sliding window
+	if (is_first_frame) { // every region was assigned again
+		for (uint idx = 0, sz = horizontal_bin_num * vertical_bin_num; idx < sz; ++idx) {
+			assign(idx, current[idx]);
+			if (leaving && V[idx] == 0) assign(idx, 0);
 		}
-		previous_assigned_maps.push_back(current_assignment_map);
 	}
 	else {
-		DensityMap old = previous_assigned_maps.back();
-		for (uint j = 0; j < vertical_bin_num; ++j) {
-			for (uint i = 0; i < horizontal_bin_num; ++i) {
-				if (changed_map[i][j]) {
-					if (old[i][j] != 0 && current_assignment_map[i][j] == 0)
-						_removed.push_back(make_pair(i, j));
-					else if (old[i][j] == 0 && current_assignment_map[i][j] != 0)
-						_added.push_back(make_pair(i, j));
-					old[i][j] = current_assignment_map[i][j];
-				}
-				// forcely remove points out of the sliding window
-				if (params.is_streaming && py.visibility_map[max_level][i][j] == 0 && old[i][j] != 0) {
-					_removed.push_back(make_pair(i, j));
-					old[i][j] = 0;
-				}
-				if (old[i][j] == 1) ++point_num;
-			}
+		// only the regions flagged as changed take the new assignment, and a point can only leave the window
+		// where the density changed, so the work follows the size of the changes
+		sort(changed_cells.begin(), changed_cells.end());
+		for (uint idx : changed_cells) {
+			changed_flags[max_level][idx] = 0;
+			assign(idx, current[idx]);
 		}
-		previous_assigned_maps.push_back(move(old));
-	}
-	qDebug() << "point number: " << point_num;
-}
-
-Indices HierarchicalSampling::getSeedIndices()
-{
-	Indices result;
-
-	for (uint i = 0; i < horizontal_bin_num; ++i) {
-		for (uint j = 0; j < vertical_bin_num; ++j) {
-			if (previous_assigned_maps.back()[i][j] != 0) {
-				result.push_back(index_map[i][j][elected_points[i][j]->label]);
-			}
+		if (leaving) {
+			for (uint idx : changed_cells)
+				if (V[idx] == 0) assign(idx, 0);
+			for (uint idx : updated_cells)
+				if (V[idx] == 0) assign(idx, 0);
 		}
 	}
-	last_frame_id = previous_assigned_maps.size() - 1;
-	return result;
+	changed_cells.clear();
+	history.push(_added, _removed);
+	qDebug() << "point number: " << selected.cells.size();
 }
 
 pair<PointSet, PointSet>* HierarchicalSampling::getSeedsDifference()
@@ -436,17 +996,16 @@ pair<PointSet, PointSet>* HierarchicalSampling::getSeedsDifference()
 	static int current_point_num;
 	if (is_first_frame) current_point_num = 0;
 
-	for (auto& idx : this->_removed) {
-		removed.push_back(make_unique<LabeledPoint>(elected_points[idx.first][idx.second]));
-	}
-	for (auto& idx : this->_added) {
-		added.push_back(make_unique<LabeledPoint>(elected_points[idx.first][idx.second]));
-	}
+	removed.reserve(_removed.size()), added.reserve(_added.size());
+	for (uint cell : _removed)
+		removed.push_back(elected_points[cell]);
+	for (uint cell : _added)
+		added.push_back(elected_points[cell]);
 	int change = ((int)added.size() - (int)removed.size());
 	qDebug() << "modified points:" << (int)added.size() + (int)removed.size();
 	current_point_num += change;
 
-	last_frame_id = previous_assigned_maps.size() - 1;
+	last_frame_id = history.size() - 1;
 	return new pair<PointSet, PointSet>(move(removed), move(added));
 }
 
@@ -454,36 +1013,28 @@ pair<PointSet, PointSet> HierarchicalSampling::getSeedsWithDiff()
 {
 	PointSet result, diff;
 
-	for (uint i = 0; i < horizontal_bin_num; ++i) {
-		for (uint j = 0; j < vertical_bin_num; ++j) {
-			if (previous_assigned_maps[params.displayed_frame_id][i][j] != 0) {
-				if (last_frame_id != -1 && previous_assigned_maps[last_frame_id][i][j] != 0) {
-					result.push_back(make_unique<LabeledPoint>(elected_points[i][j]));
-				}
-				else {
-					diff.push_back(make_unique<LabeledPoint>(elected_points[i][j]));
-				}
-			}
-		}
-	}
+	auto displayed = history.frame(params.displayed_frame_id);
+	FrameHistory::Bitmap last;
+	if (last_frame_id != -1) last = history.frame(last_frame_id);
+	FrameHistory::forEachCell(displayed, [&](uint cell) {
+		if (last_frame_id != -1 && FrameHistory::test(last, cell))
+			result.push_back(elected_points[cell]);
+		else
+			diff.push_back(elected_points[cell]);
+	});
 	last_frame_id = params.displayed_frame_id;
 	return make_pair(move(result), move(diff));
 }
 
 PointSet HierarchicalSampling::getSeeds()
 {
-	if (previous_assigned_maps.empty()) return PointSet();
+	if (history.empty()) return PointSet();
 
-	int frame_id = params.displayed_frame_id > previous_assigned_maps.size() ? previous_assigned_maps.size() - 1 : params.displayed_frame_id - 1;
+	int frame_id = params.displayed_frame_id > history.size() ? history.size() - 1 : params.displayed_frame_id - 1;
 
+	auto selected = history.frame(frame_id);
 	PointSet result;
-	for (uint i = 0; i < horizontal_bin_num; ++i) {
-		for (uint j = 0; j < vertical_bin_num; ++j) {
-			if (previous_assigned_maps[frame_id][i][j] != 0) {
-				result.push_back(make_unique<LabeledPoint>(elected_points[i][j]));
-			}
-		}
-	}
+	FrameHistory::forEachCell(selected, [&](uint cell) { result.push_back(elected_points[cell]); });
 	last_frame_id = params.displayed_frame_id;
 	return result;
 }
@@ -1,40 +1,117 @@
 #pragma once
 
 #include <QRect>
+#include <array>
 #include <set>
+#include <limits>
 #include <random>
 
 #include "global.h"
+#include "FrameHistory.h"
+#include "PyramidKernels.h"
+#include "ThreadPool.h"
 #include "utils.h"
 
-using DensityMap = std::vector<std::vector<int>>;
-
 extern Param params;
 extern std::vector<int> selected_class_order;
 
+// the density, visibility and assignment pyramids, each map type is kept in one buffer level after level,
+// level k is a row-major rows(k) x cols(k) map starting at an aligned offset, so (i, j) is at i * cols(k) + j
 class Pyramid
 {
 public:
 	friend class HierarchicalSampling;
 	enum MapType {Density, Visibility, Assignment};
-	int getVal(MapType t, int level, const std::pair<int, int>& idx) {
-		switch (t)
-		{
-		case Pyramid::Density:
-			return density_map[level][idx.first][idx.second];
-		case Pyramid::Visibility:
-			return visibility_map[level][idx.first][idx.second];
-		case Pyramid::Assignment:
-			return assignment_map[level][idx.first][idx.second];
-		default:
-			exit(-1); // error
-		}
-	}
-	
+
+	// allocates the levels 0 to max_level, the finest level has rows x cols cells and every coarser level
+	// halves both rounding up, so a region at the odd edge of a level has fewer than four children
+	void resize(int max_level, int rows, int cols);
+	int rows(int level) const { return dims[level].first; }
+	int cols(int level) const { return dims[level].second; }
+	int* level(MapType t, int level) { return maps[t].data() + offsets[level]; }
+	const int* level(MapType t, int level) const { return maps[t].data() + offsets[level]; }
+	int getVal(MapType t, int k, int i, int j) const { return level(t, k)[i * dims[k].second + j]; }
+	// zeroes every level of the three maps
+	void clear();
+
+private:
+	AlignedBuffer<int> maps[3];
+	std::vector<size_t> offsets;
+	std::vector<std::pair<int, int>> dims;
+};
+
+// the density added to the finest level by the points of one time step of a stream
+struct TimeSlot
+{
+	qint64 time = std::numeric_limits<qint64>::min(); // min if the slot is free
+	std::vector<std::pair<uint, int>> increments; // (cell, count) with count > 0, sorted by cell
+	std::vector<uint> pending; // the cells of the points not merged into increments yet
+
+	bool isFree() const { return time == std::numeric_limits<qint64>::min(); }
+	// moves the pending cells into increments
+	void merge();
+	void clear();
+};
+
+// a reservoir of one representative over the points of a cell (Algorithm L), which draws random numbers only when
+// the representative is replaced, they are keyed by the id of that point so any split among threads gives the same result
+struct CellReservoir
+{
+	uint32_t seen = 0; // the number of points offered since the reservoir was empty
+	uint32_t next = 0; // the value of seen at which the next replacement is due
+	float w = 0; // the largest key of a point kept so far, in the order statistics view of the algorithm
+
+	// offers the next point of the cell, returns true if it becomes the representative
+	bool offer(uint id, uint64_t seed);
+	// continues after the representative was picked uniformly from count points by other means
+	void resume(uint32_t count, uint id, uint64_t seed);
+	void clear() { seen = 0; }
+
 private:
-	std::vector<DensityMap> density_map;
-	std::vector<DensityMap> visibility_map;
-	std::vector<DensityMap> assignment_map;
+	// draws the number of points skipped before the next replacement
+	void skip(uint id, uint64_t seed);
+};
+
+// the finest cells selected in the last frame and the index of their representatives, packed in any order,
+// with the position of every cell in the packed arrays so that a cell is added, removed or looked up in O(1)
+struct SelectedCells
+{
+	const static uint NONE = std::numeric_limits<uint>::max();
+	std::vector<uint> cells;
+	Indices ids;
+	std::vector<uint> position; // the index of a cell in cells, NONE if not selected
+
+	void reset(size_t cell_num) { cells.clear(), ids.clear(), position.assign(cell_num, NONE); }
+	bool contains(uint cell) const { return position[cell] != NONE; }
+	void insert(uint cell, uint id)
+	{
+		position[cell] = static_cast<uint>(cells.size());
+		cells.push_back(cell), ids.push_back(id);
+	}
+	// moves the last cell into the place of the removed one
+	void erase(uint cell)
+	{
+		uint p = position[cell], last = cells.back();
+		cells[p] = last, ids[p] = ids.back(), position[last] = p;
+		cells.pop_back(), ids.pop_back();
+		position[cell] = NONE;
+	}
+	// follows a new representative of the cell if it is selected
+	void setId(uint cell, uint id)
+	{
+		if (position[cell] != NONE) ids[position[cell]] = id;
+	}
+};
+
+// the points of one class on the finest grid
+struct ClassChannel
+{
+	AlignedBuffer<int> density;
+	std::vector<LabeledPoint> points; // the representative of the class in every cell
+	std::vector<uint> ids; // the index of the representative in the data source
+	std::vector<CellReservoir> reservoirs;
+
+	explicit ClassChannel(size_t cell_num) : density(cell_num), points(cell_num), ids(cell_num), reservoirs(cell_num) {}
 };
 
 class HierarchicalSampling
@@ -43,9 +120,19 @@ public:
 	HierarchicalSampling(const QRect& bounding_rect);
 
 	// the main function that executes the sampling process and returns added and removed points in comparison to the previous frame
-	std::pair<PointSet, PointSet>* execute(const FilteredPointSet* origin, bool is_first_frame);
-
-	Indices getSeedIndices();
+	std::pair<PointSet, PointSet>* execute(const PointStore* origin, bool is_first_frame);
+	// samples the last ingested data again with the current params and returns added and removed points in comparison to the current frame,
+	// returns nullptr if nothing was ingested yet
+	std::pair<PointSet, PointSet>* resample();
+	// moves the last ingested data to the current params.grid_width by aggregating the base grid and samples it,
+	// returns nullptr if there is no base grid or the grid width is not a multiple of its width, then the data has to be read again
+	std::pair<PointSet, PointSet>* regrid();
+	// rebuilds the density of the last ingested data from the classes in selected_class_order and samples it,
+	// returns nullptr if the classes were not kept apart, then the data has to be read again
+	std::pair<PointSet, PointSet>* reclassify();
+
+	// the index of the selected points of the last frame in the data source, in no particular order
+	const Indices& getSeedIndices() const { return selected.ids; }
 	// returns the index of added and removed points in comparison to the previous frame
 	std::pair<PointSet, PointSet>* getSeedsDifference();
 	// returns the unchanged and changed points between the result of current params.displayed_frame_id and the last result
@@ -55,48 +142,94 @@ public:
 	int getFrameID() { return last_frame_id; }
 
 private:
-	// sum the values of four children nodes at the given level
-	void constructionHelper(std::vector<DensityMap>& map_list, int level, int i, int j);
-	// classify regions to high- and low-density according to \lambda
-	std::vector<std::vector<std::pair<int, int>>> classifyRegions(int level, const std::vector<std::pair<int, int>>& indices);
-	// determine whether the adjacent regions violate the data density ratios and perform the sampling refinement at the given level
-	void smoothingHelper(DensityMap& assignment_map, std::pair<int, int>&& pos_x, std::pair<int, int>&& pos_y, int level);
-	// for the local region update stage
-	bool detectChangedRegion(int level, const std::vector<std::pair<int, int>>& indices);
+	// size the grids and maps to params.grid_width
+	void allocateGrids();
+	// start an empty history of frames for the current grid
+	void resetHistory();
+	// the assign step for the children of region (i, j) of the parent level, writing into the assignment A of the given level,
+	// ranks classifies the children to high- and low-density according to \lambda, see rankChildren()
+	void assignRegion(int level, int i, int j, const ChildRanks& ranks, int* A);
+	// determine whether the adjacent regions violate the data density ratios and perform the sampling refinement at the given level,
+	// x and y are positions in the level and assignment_map holds the assignment of the level
+	void smoothingHelper(int* assignment_map, int x, int y, int level);
+	// for the local region update stage, (i, j) is the parent of the first n regions of indices at the given level
+	bool detectChangedRegion(int level, int i, int j, const std::array<int, 4>& indices, int n);
 	// for the adjacent region refinement stage
-	void adjacentChangedHelper(const DensityMap& assignment_map, std::pair<int, int>&& pos_x, std::pair<int, int>&& pos_y, int level);
+	// returns the position in the level of the region it marked as changed, -1 if none
+	int adjacentChangedHelper(const int* assignment_map, std::pair<int, int>&& pos_x, std::pair<int, int>&& pos_y, int level);
+	// whether the region or one of its ancestors is "changed", valid once the flags above the level are pushed down
 	bool isChangedRegion(int level, int i, int j);
-	// set all subregions to "changed" in the expanded map
 	void setChangedRegion(int level, int i, int j);
+	// mark the children of the changed regions of level - 1 as changed, the finest ones are also listed in changed_cells
+	void pushChangedDown(int level);
 
 	// initialize the predefined density maps
 	void initializeGrids();
+	// record a finest cell whose density or assignment changed since the pyramids were last updated
+	void markDirty(uint cell);
+	// make the point the representative of the finest cell
+	void elect(uint cell, const LabeledPoint& point, uint id);
 	// the framework of pyramid-based sampling
-	void computeAssignMapsProgressively(const FilteredPointSet* origin);
+	void computeAssignMapsProgressively(const PointStore* origin);
 	// map input points to screen
-	void convertToDensityMap(const FilteredPointSet* origin);
-	// construct density pyramid, visibility pyramid, and assignment pyramid if it is not the first frame
+	void convertToDensityMap(const PointStore* origin);
+	// rebuilds the ring of time slots after params.time_window changed, the slots out of the new window are expired first
+	void resizeSlidingWindow();
+	// the slot of the sliding window for the given time
+	TimeSlot& timeSlot(qint64 time);
+	// removes the density of the slot and frees it
+	void expireTimeSlot(TimeSlot* slot);
+	// adds a point at the given time to the decayed density of the cell
+	void addDecayed(uint cell, qint64 time);
+	// sets the finest density to the decayed density at newest_time, for every cell in fading_cells or only for the dirty ones
+	void updateDecayedDensity(bool all_cells);
+	// bring the density, visibility and assignment pyramids up to date with the dirty cells
 	void constructPyramids();
 	// the main sampling procedure described by the Algorithm 1 in the paper
 	void generateAssignmentMapsHierarchically();
 
-	struct DateHash {
-	public:
-		std::size_t operator()(const QDate &d) const
-		{
-			return std::hash<int>{}(d.year()) * 372 + std::hash<int>{}(d.month()) * 31 + std::hash<int>{}(d.day()); // 12 * 31 = 372
-		}
-	};
-	std::unordered_map<QDate, DensityMap, DateHash> sliding_window;
-
-	Pyramid py;
-	std::vector<std::vector<bool>> changed_map;
-	std::vector<DensityMap> previous_assigned_maps;
-
-	std::vector<std::vector<std::unique_ptr<LabeledPoint>>> elected_points;
-	std::vector<std::vector<std::unordered_map<uint, uint>>> index_map;
-	std::vector<std::pair<int, int>> _added, _removed;
-
+	std::vector<TimeSlot> sliding_window; // a ring of params.time_window + 1 slots indexed by time modulo its size, resized when the window changes
+	qint64 newest_time; // the latest time in the sliding window
+	// with half_life, a point at time t adds 2^((t - decay_epoch) / half_life) in fixed point to its cell,
+	// so the density at time now is the weight scaled by 2^(-(now - decay_epoch) / half_life)
+	std::vector<uint64_t> decayed_weight;
+	qint64 decay_epoch;
+	uint half_life; // params.half_life when the grids were initialized
+	std::vector<uint> fading_cells; // the cells with a decayed density above 0, the only ones rescaled when the stream moves on
+	std::vector<uint8_t> fading_flag; // whether a cell is in fading_cells
+
+	Pyramid py; // the assignment pyramid holds the result of the last frame
+	std::vector<uint> dirty_cells; // the finest cells changed since the last update of the pyramids
+	std::vector<uint8_t> dirty_flag; // whether a finest cell is in dirty_cells
+	std::vector<std::vector<uint8_t>> changed_flags; // per level, row-major like the pyramid
+	std::vector<uint> changed_cells; // the finest cells flagged as changed in this frame
+	std::vector<uint> updated_cells; // the finest cells that were dirty when the pyramids were last updated
+	AlignedBuffer<int> current_assignment, next_assignment; // the assignment of the level being refined and of its children
+	FrameHistory history; // the selected finest cells of each frame
+	SelectedCells selected; // the same cells as history.last()
+
+	// with params.base_grid_width, the number of points and a representative of every cell of that width,
+	// which serve any grid width that is a multiple of it without reading the data again
+	uint base_width = 0, base_horizontal_num = 0, base_vertical_num = 0;
+	std::vector<int> base_density;
+	std::vector<LabeledPoint> base_points;
+	std::vector<uint> base_ids;
+	std::vector<CellReservoir> base_reservoirs;
+
+	// with params.class_channels in a static setting, the density of every class indexed by label, which includes the
+	// unselected ones, so the finest density map is the sum of the selected channels
+	bool keep_classes = false;
+	std::vector<ClassChannel> class_channels;
+	ClassMask channel_mask; // the classes summed into the finest density map
+
+	// the representative of every finest cell and its index in the data source, a class has its own representatives
+	// only in class_channels, as the id of the elected point is the only one ever asked for
+	PointSet elected_points;
+	Indices elected_ids;
+	std::vector<CellReservoir> reservoirs; // restarted when the density of the cell drops to 0
+	std::vector<uint> _added, _removed; // the finest cells added to and removed from the last frame
+
+	QRect bounding_rect;
 	uint horizontal_bin_num, // the actual number of horizontal bins
 		vertical_bin_num; // the actual number of vertical bins
 	int max_level;
@@ -106,4 +239,5 @@ private:
 
 	std::mt19937 gen{ std::random_device{}() };
 	std::uniform_real_distribution<> double_dist;
+	uint64_t election_seed; // the seed of the reservoirs of the cells, see hashUniform()
 };
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+	if (this != &other) {
+		close();
+		swap(begin, other.begin);
+		swap(length, other.length);
+		swap(is_open, other.is_open);
+#ifdef _WIN32
+		swap(file_handle, other.file_handle);
+		swap(mapping_handle, other.mapping_handle);
+#else
+		swap(fd, other.fd);
+#endif
+	}
+	return *this;
+}
+
+void MappedFile::open(const string& path)
+{
+	close();
+#ifdef _WIN32
+	HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (f == INVALID_HANDLE_VALUE)
+		throw runtime_error("cannot open " + path);
+	LARGE_INTEGER sz;
+	if (!GetFileSizeEx(f, &sz)) {
+		CloseHandle(f);
+		throw runtime_error("cannot stat " + path);
+	}
+	file_handle = f;
+	length = static_cast<size_t>(sz.QuadPart);
+	if (length > 0) { // an empty file cannot be mapped
+		mapping_handle = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping_handle)
+			begin = static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+		if (!begin) {
+			close();
+			throw runtime_error("cannot map " + path);
+		}
+	}
+#else
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw runtime_error("cannot open " + path);
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		fd = -1;
+		throw runtime_error("cannot stat " + path);
+	}
+	length = static_cast<size_t>(st.st_size);
+	if (length > 0) { // an empty file cannot be mapped
+		void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED) {
+			close();
+			throw runtime_error("cannot map " + path);
+		}
+		begin = static_cast<const char*>(addr);
+		madvise(addr, length, MADV_SEQUENTIAL);
+	}
+#endif
+	is_open = true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (begin) UnmapViewOfFile(begin);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+	file_handle = mapping_handle = nullptr;
+#else
+	if (begin) munmap(const_cast<char*>(begin), length);
+	if (fd >= 0) ::close(fd);
+	fd = -1;
+#endif
+	begin = nullptr;
+	length = 0;
+	is_open = false;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) { *this = std::move(other); }
+	MappedFile& operator=(MappedFile&& other);
+	~MappedFile() { close(); }
+
+	// throws std::runtime_error if the file cannot be opened or mapped
+	void open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return is_open; }
+	const char* data() const { return begin; }
+	size_t size() const { return length; }
+
+private:
+	const char* begin = nullptr;
+	size_t length = 0;
+	bool is_open = false;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#else
+	int fd = -1;
+#endif
+};
@@ -0,0 +1,188 @@
+#include "PointFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "CSVReader.h"
+
+using namespace std;
+
+const static char POINT_FILE_MAGIC[8] = { 'P', 'B', 'S', 'P', 'O', 'I', 'N', 'T' };
+const static uint32_t POINT_FILE_VERSION = 2;
+
+namespace {
+
+inline uint64_t alignColumn(uint64_t offset)
+{
+	return (offset + 63) & ~63ull;
+}
+
+}
+
+bool isPointFile(const string& path)
+{
+	size_t len = strlen(POINT_FILE_EXTENSION);
+	if (path.size() < len) return false;
+	return equal(path.end() - len, path.end(), POINT_FILE_EXTENSION, [](char a, char b) { return tolower(a) == b; });
+}
+
+void convertToPointFile(const string& csv_path, const string& point_file_path, bool with_date)
+{
+	MappedFile csv;
+	csv.open(csv_path);
+	const char* begin = csv.data();
+	const char* end = begin + csv.size();
+	while (begin < end && static_cast<signed char>(*begin) < 0) ++begin; // skip invalid char
+	uint64_t capacity = count(begin, end, '\n') + 1; // upper bound of the number of rows
+
+	PointFileHeader h = {};
+	memcpy(h.magic, POINT_FILE_MAGIC, sizeof(h.magic));
+	h.version = POINT_FILE_VERSION;
+	h.has_time = with_date;
+	h.x_offset = alignColumn(sizeof(h));
+	h.y_offset = alignColumn(h.x_offset + capacity * sizeof(float));
+	h.label_offset = alignColumn(h.y_offset + capacity * sizeof(float));
+	uint64_t columns_end = h.label_offset + capacity * sizeof(uint32_t);
+	if (with_date) {
+		h.time_offset = alignColumn(columns_end);
+		columns_end = h.time_offset + capacity * sizeof(int64_t);
+	}
+
+	ofstream output(point_file_path, ios_base::binary | ios_base::trunc);
+	if (!output)
+		throw runtime_error("cannot create " + point_file_path);
+	auto writeAt = [&output](uint64_t offset, const void* data, size_t bytes) {
+		output.seekp(offset);
+		output.write(static_cast<const char*>(data), bytes);
+	};
+
+	const size_t BUFFER_SIZE = 1 << 20;
+	vector<float> xs, ys;
+	vector<uint32_t> ls;
+	vector<int64_t> ts;
+	uint64_t n = 0, flushed = 0;
+	auto flush = [&]() {
+		writeAt(h.x_offset + flushed * sizeof(float), xs.data(), xs.size() * sizeof(float));
+		writeAt(h.y_offset + flushed * sizeof(float), ys.data(), ys.size() * sizeof(float));
+		writeAt(h.label_offset + flushed * sizeof(uint32_t), ls.data(), ls.size() * sizeof(uint32_t));
+		if (with_date)
+			writeAt(h.time_offset + flushed * sizeof(int64_t), ts.data(), ts.size() * sizeof(int64_t));
+		flushed = n;
+		xs.clear(), ys.clear(), ls.clear(), ts.clear();
+	};
+
+	vector<string> labels;
+	unordered_map<string, uint32_t> label2class;
+	vector<TimeRun> runs;
+	CSVReader::Row r;
+	for (const char* p = begin; p < end;) {
+		if (*p == '\n' || *p == '\r') { // skip empty lines
+			++p;
+			continue;
+		}
+		p = CSVReader::parseRow(p, end, with_date, &r);
+
+		string l(r.label_begin, r.label_end);
+		auto it = label2class.find(l);
+		if (it == label2class.end()) { // classes are numbered by first appearance, as CSVReader does
+			it = label2class.emplace(l, static_cast<uint32_t>(labels.size())).first;
+			labels.push_back(l);
+		}
+		xs.push_back(static_cast<float>(r.x));
+		ys.push_back(static_cast<float>(r.y));
+		ls.push_back(it->second);
+		if (with_date) {
+			if (runs.empty() || runs.back().time != r.time)
+				runs.push_back({ r.time, n });
+			ts.push_back(r.time);
+		}
+		++n;
+		if (xs.size() == BUFFER_SIZE)
+			flush();
+	}
+	flush();
+	h.point_num = n;
+
+	// label dictionary and chunk index follow the columns
+	output.seekp(columns_end);
+	h.dictionary_offset = columns_end;
+	h.label_num = labels.size();
+	for (auto& l : labels) {
+		uint32_t len = static_cast<uint32_t>(l.size());
+		output.write(reinterpret_cast<const char*>(&len), sizeof(len));
+		output.write(l.data(), len);
+	}
+	h.run_offset = alignColumn(static_cast<uint64_t>(output.tellp()));
+	h.run_num = runs.size();
+	if (!runs.empty())
+		writeAt(h.run_offset, runs.data(), runs.size() * sizeof(TimeRun));
+	writeAt(0, &h, sizeof(h));
+
+	if (!output)
+		throw runtime_error("cannot write " + point_file_path);
+}
+
+void PointFileReader::open(const string& filename)
+{
+	close();
+	file.open(filename);
+
+	auto invalid = [&]() {
+		file.close();
+		return runtime_error(filename + " is not a valid point file");
+	};
+	if (file.size() < sizeof(PointFileHeader))
+		throw invalid();
+	PointFileHeader h;
+	memcpy(&h, file.data(), sizeof(h));
+	uint64_t sz = file.size(), column_bytes = h.point_num * sizeof(float);
+	if (memcmp(h.magic, POINT_FILE_MAGIC, sizeof(h.magic)) != 0 || h.version != POINT_FILE_VERSION ||
+		h.x_offset + column_bytes > sz || h.y_offset + column_bytes > sz || h.label_offset + column_bytes > sz ||
+		(h.has_time && h.time_offset + 2 * column_bytes > sz) || (h.run_num > 0 && h.run_offset + h.run_num * sizeof(TimeRun) > sz))
+		throw invalid();
+
+	const char* data = file.data();
+	x = reinterpret_cast<const float*>(data + h.x_offset);
+	y = reinterpret_cast<const float*>(data + h.y_offset);
+	label = reinterpret_cast<const uint*>(data + h.label_offset);
+	time = h.has_time ? reinterpret_cast<const qint64*>(data + h.time_offset) : nullptr;
+	runs = reinterpret_cast<const TimeRun*>(data + h.run_offset);
+	point_num = h.point_num;
+	run_num = h.run_num;
+
+	labels.clear();
+	for (uint64_t i = 0, off = h.dictionary_offset; i < h.label_num; ++i) {
+		uint32_t len;
+		if (off + sizeof(len) > sz) throw invalid();
+		memcpy(&len, data + off, sizeof(len));
+		off += sizeof(len);
+		if (off + len > sz) throw invalid();
+		labels.emplace_back(data + off, len);
+		off += len;
+	}
+}
+
+PointChunk PointFileReader::read(unordered_map<uint, string>* class2label)
+{
+	for (uint i = 0; i < labels.size(); ++i)
+		class2label->emplace(i, labels[i]);
+
+	uint64_t begin = pos, end;
+	if (params.is_streaming && time && run_num > 0) {
+		while (run + 1 < run_num && runs[run + 1].first <= pos) ++run;
+		// cut at the first run which is at least params.time_step time units after the previous run
+		auto units = [this](uint64_t r) { return toTimeUnits(runs[r].time, params.time_unit); };
+		uint64_t r = run + 1;
+		while (r < run_num && units(r) - units(r - 1) < params.time_step) ++r;
+		end = r < run_num ? runs[r].first : point_num;
+		run = r;
+	}
+	else {
+		end = min<uint64_t>(point_num, pos + params.chunk_size);
+	}
+	pos = end;
+
+	return PointChunk{ x + begin, y + begin, label + begin, time ? time + begin : nullptr, static_cast<size_t>(end - begin) };
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "global.h"
+#include "MappedFile.h"
+
+extern Param params;
+
+/*
+ * Binary columnar point file (*.pbs), little endian:
+ *   PointFileHeader
+ *   x column (float), y column (float), label column (uint32), time column (int64, optional), each 64-byte aligned
+ *   label dictionary: label_num entries of (uint32 length, characters), ordered by class
+ *   chunk index: run_num TimeRun entries, one per run of consecutive points sharing the same timestamp
+ */
+struct PointFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t has_time;
+	uint64_t point_num;
+	uint64_t x_offset;
+	uint64_t y_offset;
+	uint64_t label_offset;
+	uint64_t time_offset;
+	uint64_t dictionary_offset;
+	uint64_t label_num;
+	uint64_t run_offset;
+	uint64_t run_num;
+};
+
+struct TimeRun {
+	int64_t time; // seconds since 1970-01-01 UTC
+	uint64_t first; // index of the first point of the run
+};
+
+const char POINT_FILE_EXTENSION[] = ".pbs";
+
+// true if the path has the point file extension
+bool isPointFile(const std::string& path);
+
+// converts the "[date,]x,y,label" csv layout to a point file, the date column is expected if with_date is set
+// throws std::runtime_error on I/O errors
+void convertToPointFile(const std::string& csv_path, const std::string& point_file_path, bool with_date);
+
+// memory-maps a point file and hands out chunks that point into the mapping
+class PointFileReader
+{
+public:
+	// throws std::runtime_error if the file cannot be opened or is not a point file
+	void open(const std::string& filename);
+	void close() { file.close(); pos = 0; run = 0; }
+	bool eof() const { return pos >= point_num; }
+
+	// returns the next chunk, which is cut by params.chunk_size or by params.time_step in the streaming setting,
+	// the chunk stays valid until the reader is closed
+	PointChunk read(std::unordered_map<uint, std::string>* class2label);
+
+private:
+	MappedFile file;
+	const float* x = nullptr;
+	const float* y = nullptr;
+	const uint* label = nullptr;
+	const qint64* time = nullptr;
+	const TimeRun* runs = nullptr;
+	uint64_t point_num = 0, run_num = 0;
+	std::vector<std::string> labels;
+
+	uint64_t pos = 0; // the first point of the next chunk
+	uint64_t run = 0; // the run containing pos
+};
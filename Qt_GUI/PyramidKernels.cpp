@@ -0,0 +1,225 @@
+#include "PyramidKernels.h"
+
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PYRAMID_USE_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER) || defined(__GNUC__)
+#define PYRAMID_USE_AVX2 // compiled for any x86 target, used only if the cpu supports it
+#include <immintrin.h>
+#endif
+#endif
+
+#ifdef PYRAMID_USE_AVX2
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PYRAMID_TARGET_AVX2
+#else
+#define PYRAMID_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+// sums the 2x2 blocks of two adjacent child rows into n parent cells
+using RowKernel = void(*)(const int* row1, const int* row2, int* dst, int n);
+
+void reduceRowScalar(const int* row1, const int* row2, int* dst, int n)
+{
+	for (int j = 0; j < n; ++j)
+		dst[j] = row1[2 * j] + row1[2 * j + 1] + row2[2 * j] + row2[2 * j + 1];
+}
+
+#ifdef PYRAMID_USE_SSE2
+void reduceRowSSE2(const int* row1, const int* row2, int* dst, int n)
+{
+	int j = 0;
+	for (; j + 4 <= n; j += 4) {
+		__m128 lo = _mm_castsi128_ps(_mm_add_epi32(_mm_loadu_si128((const __m128i*)(row1 + 2 * j)), _mm_loadu_si128((const __m128i*)(row2 + 2 * j)))),
+			hi = _mm_castsi128_ps(_mm_add_epi32(_mm_loadu_si128((const __m128i*)(row1 + 2 * j + 4)), _mm_loadu_si128((const __m128i*)(row2 + 2 * j + 4))));
+		// even and odd columns of the eight summed children
+		__m128i even = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))),
+			odd = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+		_mm_storeu_si128((__m128i*)(dst + j), _mm_add_epi32(even, odd));
+	}
+	reduceRowScalar(row1 + 2 * j, row2 + 2 * j, dst + j, n - j);
+}
+#endif
+
+#ifdef PYRAMID_USE_AVX2
+PYRAMID_TARGET_AVX2 void reduceRowAVX2(const int* row1, const int* row2, int* dst, int n)
+{
+	int j = 0;
+	for (; j + 8 <= n; j += 8) {
+		__m256i lo = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(row1 + 2 * j)), _mm256_loadu_si256((const __m256i*)(row2 + 2 * j))),
+			hi = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(row1 + 2 * j + 8)), _mm256_loadu_si256((const __m256i*)(row2 + 2 * j + 8)));
+		// the pairs come out per 128-bit lane as lo[0..3], hi[0..3], lo[4..7], hi[4..7]
+		__m256i sums = _mm256_hadd_epi32(lo, hi);
+		_mm256_storeu_si256((__m256i*)(dst + j), _mm256_permute4x64_epi64(sums, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	reduceRowScalar(row1 + 2 * j, row2 + 2 * j, dst + j, n - j);
+}
+
+bool hasAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	const int osxsave = 1 << 27, avx = 1 << 28;
+	if ((info[2] & (osxsave | avx)) != (osxsave | avx) || (_xgetbv(0) & 6) != 6) return false; // the os saves the ymm registers
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+// ranks the children in d, a missing child has a density of -1
+void rankScalar(const int d[4], double threshold_ratio, ChildRanks* out)
+{
+	int key[4] = { d[0], d[1], d[2], d[3] };
+	uint8_t pos[4] = { 0, 1, 2, 3 };
+	// a sorting network, a pair is swapped if the second one is denser or equally dense but earlier
+	auto exchange = [&](int a, int b) {
+		if (key[b] > key[a] || (key[b] == key[a] && pos[b] < pos[a]))
+			std::swap(key[a], key[b]), std::swap(pos[a], pos[b]);
+	};
+	exchange(0, 1), exchange(2, 3), exchange(0, 2), exchange(1, 3), exchange(1, 2);
+	const double threshold = threshold_ratio * key[0];
+	out->child_mask = out->low_mask = 0;
+	for (int c = 0; c < 4; ++c) {
+		out->order[c] = pos[c];
+		if (d[c] < 0) continue;
+		out->child_mask |= 1 << c;
+		if (d[c] < threshold) out->low_mask |= 1 << c;
+	}
+}
+
+#ifdef PYRAMID_USE_SSE2
+// the lanes of key and pos of a are swapped with those of b where b ranks first, as in rankScalar()
+inline void exchange4(__m128i& key_a, __m128i& pos_a, __m128i& key_b, __m128i& pos_b)
+{
+	__m128i swap = _mm_or_si128(_mm_cmpgt_epi32(key_b, key_a), _mm_and_si128(_mm_cmpeq_epi32(key_b, key_a), _mm_cmpgt_epi32(pos_a, pos_b)));
+	__m128i key = _mm_xor_si128(key_a, key_b), pos = _mm_xor_si128(pos_a, pos_b);
+	key_a = _mm_xor_si128(key_a, _mm_and_si128(swap, key)), key_b = _mm_xor_si128(key_b, _mm_and_si128(swap, key));
+	pos_a = _mm_xor_si128(pos_a, _mm_and_si128(swap, pos)), pos_b = _mm_xor_si128(pos_b, _mm_and_si128(swap, pos));
+}
+
+// the bits of the lanes of d below the lanes of threshold, which are computed in double precision like the scalar comparison
+inline int lessMask(__m128i d, __m128d threshold_lo, __m128d threshold_hi)
+{
+	return _mm_movemask_pd(_mm_cmplt_pd(_mm_cvtepi32_pd(d), threshold_lo))
+		| _mm_movemask_pd(_mm_cmplt_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2))), threshold_hi)) << 2;
+}
+
+// ranks the children of four parents with complete 2x2 blocks, one parent per lane
+void rankSSE2(const int* row1, const int* row2, double threshold_ratio, ChildRanks* out)
+{
+	__m128 a = _mm_loadu_ps((const float*)row1), b = _mm_loadu_ps((const float*)(row1 + 4)),
+		c = _mm_loadu_ps((const float*)row2), d = _mm_loadu_ps((const float*)(row2 + 4));
+	__m128i child[4] = {
+		_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+		_mm_castps_si128(_mm_shuffle_ps(c, d, _MM_SHUFFLE(2, 0, 2, 0))),
+		_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_castps_si128(_mm_shuffle_ps(c, d, _MM_SHUFFLE(3, 1, 3, 1)))
+	};
+	__m128i key[4] = { child[0], child[1], child[2], child[3] },
+		pos[4] = { _mm_setzero_si128(), _mm_set1_epi32(1), _mm_set1_epi32(2), _mm_set1_epi32(3) };
+	exchange4(key[0], pos[0], key[1], pos[1]), exchange4(key[2], pos[2], key[3], pos[3]);
+	exchange4(key[0], pos[0], key[2], pos[2]), exchange4(key[1], pos[1], key[3], pos[3]);
+	exchange4(key[1], pos[1], key[2], pos[2]);
+
+	const __m128d ratio = _mm_set1_pd(threshold_ratio);
+	const __m128d threshold_lo = _mm_mul_pd(ratio, _mm_cvtepi32_pd(key[0])),
+		threshold_hi = _mm_mul_pd(ratio, _mm_cvtepi32_pd(_mm_shuffle_epi32(key[0], _MM_SHUFFLE(1, 0, 3, 2))));
+	int low[4], order[4][4];
+	for (int k = 0; k < 4; ++k) {
+		low[k] = lessMask(child[k], threshold_lo, threshold_hi);
+		_mm_storeu_si128((__m128i*)order[k], pos[k]);
+	}
+	for (int lane = 0; lane < 4; ++lane) {
+		ChildRanks& r = out[lane];
+		r.child_mask = 0xF, r.low_mask = 0;
+		for (int k = 0; k < 4; ++k) {
+			r.order[k] = static_cast<uint8_t>(order[k][lane]);
+			r.low_mask |= (low[k] >> lane & 1) << k;
+		}
+	}
+}
+#endif
+
+RowKernel selectRowKernel()
+{
+#ifdef PYRAMID_USE_AVX2
+	if (hasAVX2()) return reduceRowAVX2;
+#endif
+#ifdef PYRAMID_USE_SSE2
+	return reduceRowSSE2;
+#else
+	return reduceRowScalar;
+#endif
+}
+
+}
+
+void reduce2x2(const int* const* children, int* const* parents, int map_num, int child_rows, int child_cols)
+{
+	static const RowKernel reduce_row = selectRowKernel();
+	const int rows = (child_rows + 1) / 2, cols = (child_cols + 1) / 2, pairs = child_cols / 2;
+	for (int i = 0; i < rows; ++i) {
+		for (int m = 0; m < map_num; ++m) {
+			const int* row1 = children[m] + 2 * i * child_cols;
+			int* dst = parents[m] + i * cols;
+			if (2 * i + 1 < child_rows) {
+				const int* row2 = row1 + child_cols;
+				reduce_row(row1, row2, dst, pairs);
+				if (pairs < cols) dst[pairs] = row1[child_cols - 1] + row2[child_cols - 1];
+			}
+			else { // the odd last row
+				for (int j = 0; j < pairs; ++j)
+					dst[j] = row1[2 * j] + row1[2 * j + 1];
+				if (pairs < cols) dst[pairs] = row1[child_cols - 1];
+			}
+		}
+	}
+}
+
+void sumMaps(const int* const* maps, int map_num, int* dst, size_t n)
+{
+	size_t i = 0;
+#ifdef PYRAMID_USE_SSE2
+	// every map is read once, the sums of four cells stay in a register
+	for (; i + 4 <= n; i += 4) {
+		__m128i sum = _mm_setzero_si128();
+		for (int m = 0; m < map_num; ++m)
+			sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i*)(maps[m] + i)));
+		_mm_storeu_si128((__m128i*)(dst + i), sum);
+	}
+#endif
+	for (; i < n; ++i) {
+		int sum = 0;
+		for (int m = 0; m < map_num; ++m)
+			sum += maps[m][i];
+		dst[i] = sum;
+	}
+}
+
+void rankChildren(const int* row1, const int* row2, int child_cols, double threshold_ratio, ChildRanks* out)
+{
+	const int parents = (child_cols + 1) / 2, pairs = child_cols / 2;
+	int j = 0;
+#ifdef PYRAMID_USE_SSE2
+	if (row2)
+		for (; j + 4 <= pairs; j += 4)
+			rankSSE2(row1 + 2 * j, row2 + 2 * j, threshold_ratio, out + j);
+#endif
+	for (; j < parents; ++j) {
+		const bool second_col = j < pairs;
+		int d[4] = { row1[2 * j], row2 ? row2[2 * j] : -1, second_col ? row1[2 * j + 1] : -1, row2 && second_col ? row2[2 * j + 1] : -1 };
+		rankScalar(d, threshold_ratio, out + j);
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// builds a parent pyramid level from its child level for several maps in one pass over the rows,
+// the levels are row-major, the parent has ceil(child_rows / 2) x ceil(child_cols / 2) cells and each one is the sum
+// of the 2x2 block of children at (2i, 2j), the blocks on an odd last row or column only hold the existing children
+void reduce2x2(const int* const* children, int* const* parents, int map_num, int child_rows, int child_cols);
+
+// sets dst[i] to the sum of maps[m][i] over the map_num maps, which may be 0, for the n cells
+void sumMaps(const int* const* maps, int map_num, int* dst, size_t n);
+
+// the children of a parent ranked by density, child c is in the order (2i, 2j), (2i + 1, 2j), (2i, 2j + 1), (2i + 1, 2j + 1)
+struct ChildRanks
+{
+	uint8_t order[4]; // the children by decreasing density, equal ones in the order above and the missing ones last
+	uint8_t child_mask; // bit c is set if child c exists
+	uint8_t low_mask; // bit c is set if child c has a density below the threshold
+};
+
+// ranks the children of the (child_cols + 1) / 2 parents of a row into out, row1 and row2 are the rows 2i and 2i + 1 of the child
+// density map, row2 is nullptr on an odd last row and the last parent has no second column if child_cols is odd,
+// a child is low if its density is below threshold_ratio times the largest density among its siblings
+void rankChildren(const int* row1, const int* row2, int child_cols, double threshold_ratio, ChildRanks* out);
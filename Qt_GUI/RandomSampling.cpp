@@ -4,14 +4,10 @@ using namespace std;
 
 uint RandomSampling::seeds_num = 5500;
 
-std::pair<PointSet, PointSet>* RandomSampling::execute(const FilteredPointSet * origin)
+std::pair<PointSet, PointSet>* RandomSampling::execute(const PointStore * origin)
 {
-	Indices new_points;
-	for (auto &pr : *origin) {
-		new_points.push_back(pr.first);
-		dataset.emplace(pr.first, make_unique<LabeledPoint>(pr.second));
-	}
-	existing_points.insert(existing_points.end(), new_points.begin(), new_points.end());
+	dataset.append(*origin);
+	existing_points.insert(existing_points.end(), origin->id.begin(), origin->id.end());
 	
 	chrono::time_point<chrono::steady_clock> start = chrono::high_resolution_clock::now();
 	uint num = min(seeds_num, (uint)existing_points.size());
@@ -28,9 +24,9 @@ std::pair<PointSet, PointSet>* RandomSampling::execute(const FilteredPointSet *
 	
 	PointSet removed, added;
 	for (auto idx : removed_idx)
-		removed.push_back(make_unique<LabeledPoint>(dataset.at(idx)));
+		removed.push_back(dataset.at(dataset.indexOf(idx)));
 	for (auto idx : added_idx)
-		added.push_back(make_unique<LabeledPoint>(dataset.at(idx)));
+		added.push_back(dataset.at(dataset.indexOf(idx)));
 	seeds = move(result);
 	return new pair<PointSet, PointSet>(move(removed), move(added));
 }
@@ -7,11 +7,11 @@ class RandomSampling
 public:
 	RandomSampling() {}
 	Indices getSeedIndices() { return seeds; }
-	std::pair<PointSet, PointSet>* execute(const FilteredPointSet* origin);
+	std::pair<PointSet, PointSet>* execute(const PointStore* origin);
 
 	static uint seeds_num;
 private:
-	FilteredPointSet dataset;
+	PointStore dataset;
 	Indices existing_points;
 	Indices seeds;
 };
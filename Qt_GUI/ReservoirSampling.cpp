@@ -8,20 +8,20 @@ ReservoirSampling::ReservoirSampling()
 {
 	visited_num = 0;
 	seeds.resize(seeds_num);
-	elected_points = make_unique<FilteredPointSet>();
+	elected_points = make_unique<unordered_map<uint, LabeledPoint>>();
 	removed_cache = make_unique<PointSet>();
 	int_dis = uniform_int_distribution<>(0, seeds_num-1);
 	qDebug() << "Reservoir seeds:" << seeds.size();
 }
 
-pair<PointSet, PointSet>* ReservoirSampling::execute(const FilteredPointSet* origin, bool is_first_frame)
+pair<PointSet, PointSet>* ReservoirSampling::execute(const PointStore* origin, bool is_first_frame)
 {
 	chrono::time_point<chrono::steady_clock> start = chrono::high_resolution_clock::now();
 	
 	vector<bool> modified(seeds.size(), false);
 	unordered_set<uint> _added;
 
-	auto it = origin->cbegin();
+	size_t k = 0, sz = origin->size();
 	if (is_first_frame) {
 		visited_num = 0;
 		elected_points->clear();
@@ -31,10 +31,10 @@ pair<PointSet, PointSet>* ReservoirSampling::execute(const FilteredPointSet* ori
 	if (visited_num < seeds_num) {
 		fill(modified.begin() + visited_num, modified.end(), true);
 
-		for (; it != origin->cend() && visited_num < seeds_num; ++it) {
-			seeds[visited_num] = it->first;
-			elected_points->emplace(it->first, make_unique<LabeledPoint>(it->second));
-			_added.emplace(it->first);
+		for (; k < sz && visited_num < seeds_num; ++k) {
+			seeds[visited_num] = origin->id[k];
+			elected_points->emplace(origin->id[k], origin->at(k));
+			_added.emplace(origin->id[k]);
 			++visited_num;
 		}
 		if(visited_num == seeds_num)
@@ -42,23 +42,23 @@ pair<PointSet, PointSet>* ReservoirSampling::execute(const FilteredPointSet* ori
 	}
 	
 	PointSet removed;
-	for (; it != origin->cend(); ++it) {
+	for (; k < sz; ++k) {
 		++visited_num;
 		if (visited_num >= next_target) {
 			int idx = int_dis(gen);
 			if (modified[idx]) {
 				_added.erase(seeds[idx]);
-				_added.emplace(it->first);
+				_added.emplace(origin->id[k]);
 			}
 			else {
-				removed.push_back(make_unique<LabeledPoint>(elected_points->at(seeds[idx])));
-				removed_cache->push_back(move(elected_points->at(seeds[idx])));
-				_added.emplace(it->first);
+				removed.push_back(elected_points->at(seeds[idx]));
+				removed_cache->push_back(elected_points->at(seeds[idx]));
+				_added.emplace(origin->id[k]);
 				modified[idx] = true;
 			}
 			elected_points->erase(seeds[idx]);
-			elected_points->emplace(it->first, make_unique<LabeledPoint>(it->second));
-			seeds[idx] = it->first;
+			elected_points->emplace(origin->id[k], origin->at(k));
+			seeds[idx] = origin->id[k];
 
 			W *= exp(log(double_dist(gen)) / seeds_num);
 			next_target += (int)floor(log(double_dist(gen)) / log(1 - W)) + 1;
@@ -68,7 +68,7 @@ pair<PointSet, PointSet>* ReservoirSampling::execute(const FilteredPointSet* ori
 
 	PointSet added;
 	for (auto& idx : _added) {
-		added.push_back(make_unique<LabeledPoint>(elected_points->at(idx)));
+		added.push_back(elected_points->at(idx));
 	}
 	qDebug() << "execution:" << (double)(chrono::high_resolution_clock::now() - start).count() / 1e9;
 
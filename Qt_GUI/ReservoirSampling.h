@@ -9,13 +9,13 @@ class ReservoirSampling
 public:
 	ReservoirSampling();
 	Indices getSeedIndices() { return seeds; }
-	std::pair<PointSet, PointSet>* execute(const FilteredPointSet* origin, bool is_first_frame);
+	std::pair<PointSet, PointSet>* execute(const PointStore* origin, bool is_first_frame);
 
 	static int seeds_num;
 
 private:
 	Indices seeds;
-	std::unique_ptr<FilteredPointSet> elected_points;
+	std::unique_ptr<std::unordered_map<uint, LabeledPoint>> elected_points;
 	std::unique_ptr<PointSet> removed_cache;
 
 	int visited_num, next_target;
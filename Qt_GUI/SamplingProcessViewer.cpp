@@ -1,6 +1,7 @@
 #include "SamplingProcessViewer.h"
 
 #include <QDir>
+#include <QDateTime>
 #include <QPrinter>
 #include <QSvgGenerator>
 #include <QAbstractGraphicsShapeItem>
@@ -35,6 +36,9 @@ SamplingProcessViewer::SamplingProcessViewer(std::string&& data_name, std::unord
 	paletteToColors();
 
 	connect(this, &SamplingProcessViewer::sampleStart, &sw, &SamplingWorker::readAndSample);
+	connect(this, &SamplingProcessViewer::resampleStart, &sw, &SamplingWorker::resample);
+	connect(this, &SamplingProcessViewer::regridStart, &sw, &SamplingWorker::regrid);
+	connect(this, &SamplingProcessViewer::reclassifyStart, &sw, &SamplingWorker::reclassify);
 #ifdef DRAW_ORIGIN
 	connect(&sw, &SamplingWorker::readFinished, this, &SamplingProcessViewer::drawPointsProgressively);
 #else
@@ -43,6 +47,7 @@ SamplingProcessViewer::SamplingProcessViewer(std::string&& data_name, std::unord
 	//connect(&sw, &SamplingWorker::readFinished, this, &SamplingProcessViewer::updateClassInfo);
 	connect(&sw, &SamplingWorker::sampleFinished, this, &SamplingProcessViewer::drawSelectedPointsProgressively);
 	connect(&sw, &SamplingWorker::writeFrame, [this](int frame_id) { emit frameChanged(frame_id); });
+	connect(&sw, &SamplingWorker::reclassifyFailed, this, &SamplingProcessViewer::redrawPoints);
 	//color_index = 1;
 	sw.moveToThread(&workerThread);
 	workerThread.start();
@@ -80,6 +85,7 @@ void SamplingProcessViewer::sample()
 		grid_width_changed = false;
 	}
 	sw.setDataSource(data_path);
+	keeps_classes = params.class_channels && !params.is_streaming;
 	reinitializeScreen();
 	emit sampleStart();
 
@@ -143,25 +149,23 @@ void SamplingProcessViewer::writeResult(const QString & path)
 	}
 }
 
-void SamplingProcessViewer::drawPointsProgressively(FilteredPointSet *points)
+void SamplingProcessViewer::drawPointsProgressively(PointStore *points)
 {
 	//params.use_alpha_channel = true;
-	QDate *last_date = nullptr;
-	for (auto &pr : *points) {
-		auto &p = pr.second;
-		auto it = drawPoint(p->pos.x(), p->pos.y(), params.point_radius, color_brushes[0], true);
+	qint64 last_time = std::numeric_limits<qint64>::min();
+	for (size_t i = 0, sz = points->size(); i < sz; ++i) {
+		auto it = drawPoint(points->x[i], points->y[i], params.point_radius, color_brushes[0], true);
 		if (params.is_streaming) {
-			date2item[p->date->toJulianDay()].push_back(it);
-			if (last_date == nullptr || *last_date < *p->date)
-				last_date = p->date.get(); // find the last date
+			time2item[points->time[i]].push_back(it);
+			last_time = std::max(last_time, points->time[i]); // find the last time
 		}
 	}
 	if (params.is_streaming) {
-		for (auto it = date2item.begin(); it != date2item.end();) {
-			if (QDate::fromJulianDay(it->first).daysTo(*last_date) > params.time_window) {
+		for (auto it = time2item.begin(); it != time2item.end();) {
+			if (last_time - it->first > params.time_window) {
 				for (auto ptr : it->second)
 					if (ptr) { virtual_scene->removeItem(ptr); }
-				it = date2item.erase(it);
+				it = time2item.erase(it);
 			}
 			else
 				++it;
@@ -176,25 +180,26 @@ void SamplingProcessViewer::drawSelectedPointsProgressively(std::pair<PointSet,
 {
 	auto begin = std::chrono::high_resolution_clock::now();
 	for (auto &p : removed_n_added->first) {
-		double key = p->pos.x() * CANVAS_HEIGHT + p->pos.y();
+		double key = p.pos.x() * CANVAS_HEIGHT + p.pos.y();
 		auto item = pos2item[key];
 		if (item) { this->scene()->removeItem(item); }
 		if (pos2item.find(key) != pos2item.end()) pos2item.erase(key);
 	}
-	QDate *last_date = nullptr;
+	qint64 last_time = std::numeric_limits<qint64>::min();
 	for (auto &p : removed_n_added->second) {
-		auto it = drawPoint(p->pos.x(), p->pos.y(), params.point_radius, color_brushes[p->label]);
-		pos2item.emplace(p->pos.x() * CANVAS_HEIGHT + p->pos.y(), it);
-		if (params.is_streaming && (last_date == nullptr || *last_date < *p->date))
-				last_date = p->date.get(); // find the last date
+		auto it = drawPoint(p.pos.x(), p.pos.y(), params.point_radius, color_brushes[p.label]);
+		pos2item.emplace(p.pos.x() * CANVAS_HEIGHT + p.pos.y(), it);
+		if (params.is_streaming)
+			last_time = std::max(last_time, p.time); // find the last time
 	}
 	auto end = std::chrono::high_resolution_clock::now();
 	qDebug() << "render: " << std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / 1e9;
 	const static QDate print_start(2001, 8, 10), print_end(2001, 10, 10);
-	if (last_date) {
-		qDebug() << *last_date;
-		if (*last_date > print_start && *last_date < print_end)
-			saveImagePNG("./results/StockMarket/PBS_" + last_date->toString("yyyy-MM-dd") + "_" + QString::number(params.ratio_threshold) + ".png");
+	if (last_time != std::numeric_limits<qint64>::min()) {
+		QDate last_date = QDateTime::fromMSecsSinceEpoch(last_time * params.time_unit * 1000, Qt::UTC).date();
+		qDebug() << last_date;
+		if (last_date > print_start && last_date < print_end)
+			saveImagePNG("./results/StockMarket/PBS_" + last_date.toString("yyyy-MM-dd") + "_" + QString::number(params.ratio_threshold) + ".png");
 	}
 	delete removed_n_added;
 }
@@ -247,7 +252,7 @@ void SamplingProcessViewer::drawPointRandomly(PointSet& selected)
 
 	random_shuffle(selected.begin(), selected.end());
 	for (auto &p : selected) {
-		drawPoint(p->pos.x(), p->pos.y(), params.point_radius, color_brushes[p->label]);
+		drawPoint(p.pos.x(), p.pos.y(), params.point_radius, color_brushes[p.label]);
 	}
 }
 
@@ -256,11 +261,11 @@ void SamplingProcessViewer::drawPointsByPair(std::pair<PointSet, PointSet>& sele
 	this->scene()->clear();
 	
 	for (auto &p : selected.first) {
-		drawPoint(p->pos.x(), p->pos.y(), params.point_radius, color_brushes[p->label]);
+		drawPoint(p.pos.x(), p.pos.y(), params.point_radius, color_brushes[p.label]);
 	}
 	color_index = 2;
 	for (auto &p : selected.second) {
-		drawPoint(p->pos.x(), p->pos.y(), params.point_radius, color_brushes[p->label]);
+		drawPoint(p.pos.x(), p.pos.y(), params.point_radius, color_brushes[p.label]);
 	}
 	color_index = 0;
 }
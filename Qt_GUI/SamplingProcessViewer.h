@@ -19,12 +19,20 @@ public:
 	SamplingProcessViewer(std::string&& data_name, std::unordered_map<uint, std::string>* class2label, QWidget* parent);
 	~SamplingProcessViewer() { workerThread.quit(); workerThread.wait(); }
 	void gridWidthChanged(bool changed) { grid_width_changed = changed; }
+	// whether the data being sampled keeps the density of every class, so that selecting classes can be served by reclassify()
+	bool keepsClasses() const { return keeps_classes; }
 	void setDataName(std::string&& dn) { data_name = dn; }
 	// set data path and invoke the sampling worker thread
 	void setDataPath(std::string&& data_path);
 
 	// invoke the sampling procedure in samplingworker
 	void sample();
+	// sample the data already read again with the current params, without reading the data source
+	void resample() { emit resampleStart(); }
+	// move the data already read to the current params.grid_width, if the sampler cannot do it the data is read again by sample()
+	void regrid() { emit regridStart(); }
+	// sample the data already read again with the classes in selected_class_order, if the sampler cannot do it the points are redrawn
+	void reclassify() { emit reclassifyStart(); }
 	// fetch the result of current params.displayed_frame_id parameter for HierarchicalSampling and display in the screen
 	void showSpecificFrame();
 	// redraw the current result in the screen
@@ -41,7 +49,7 @@ public:
 	const std::string ALGORITHM_NAME = "Pyramid-based Scatterplots Sampling";
 
 public slots:
-	void drawPointsProgressively(FilteredPointSet* points); // for virtual scene
+	void drawPointsProgressively(PointStore* points); // for virtual scene
 	void drawSelectedPointsProgressively(std::pair<PointSet, PointSet>* removed_n_added); // for this scene
 	void generateFiles(int frame_id);
 	void updateClassInfo();
@@ -50,6 +58,9 @@ signals:
 	void finished();
 	void redrawStart();
 	void sampleStart();
+	void resampleStart();
+	void regridStart();
+	void reclassifyStart();
 	void inputImageChanged();
 	void iterationStatus(int iteration, int numberPoints, int splits);
 	void areaCounted(StatisticalInfo* total_info, StatisticalInfo* sample_info);
@@ -75,13 +86,14 @@ private:
 	QThread workerThread;
 	SamplingWorker sw;
 	bool grid_width_changed = false;
+	bool keeps_classes = false; // params.class_channels in a static setting when the data was last read
 
 	// the file name of the dataset without suffix
 	std::string data_name;
 	std::string data_path = MY_DATASET_FILENAME;
 	std::unordered_map<uint, std::string>* class2label;
 	std::unordered_map<double, QGraphicsItem*> pos2item;
-	std::unordered_map<qint64, std::vector<QGraphicsItem*>> date2item;
+	std::unordered_map<qint64, std::vector<QGraphicsItem*>> time2item;
 	size_t last_class_num = 0;
 
 	// scene used to draw the original dataset
@@ -0,0 +1,85 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned thread_num)
+{
+	for (unsigned i = 0; i < thread_num; ++i)
+		workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	cv.notify_all();
+	for (auto& t : workers)
+		t.join();
+}
+
+ThreadPool& ThreadPool::global()
+{
+	static ThreadPool pool(max(1u, thread::hardware_concurrency()));
+	return pool;
+}
+
+void ThreadPool::work()
+{
+	for (;;) {
+		function<void()> task;
+		{
+			unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return; // stopping
+			task = move(tasks.front());
+			tasks.pop();
+		}
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(size_t n, size_t grain, const function<void(size_t, size_t)>& func)
+{
+	if (n == 0) return;
+	grain = max<size_t>(grain, 1);
+	size_t range_num = (n + grain - 1) / grain;
+	if (range_num == 1 || workers.empty()) {
+		func(0, n);
+		return;
+	}
+
+	struct State {
+		atomic<size_t> next{ 0 }, done{ 0 };
+		std::mutex m;
+		condition_variable finished;
+	};
+	auto state = make_shared<State>();
+	// late helpers find no range left and never touch func, which may be gone by then
+	auto run = [state, n, grain, range_num, &func]() {
+		for (size_t r; (r = state->next++) < range_num;) {
+			func(r * grain, min(n, (r + 1) * grain));
+			if (++state->done == range_num) {
+				lock_guard<std::mutex> lock(state->m);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	size_t helper_num = min<size_t>(workers.size(), range_num - 1);
+	{
+		lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < helper_num; ++i)
+			tasks.emplace(run);
+	}
+	cv.notify_all();
+	run();
+
+	unique_lock<std::mutex> lock(state->m);
+	state->finished.wait(lock, [&state, range_num]() { return state->done == range_num; });
+}
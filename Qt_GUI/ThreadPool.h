@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// a fixed set of worker threads shared by the parallel stages of the sampling pipeline
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned thread_num);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// the pool shared by the whole application, sized to the hardware concurrency
+	static ThreadPool& global();
+
+	unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+	template<class F>
+	auto submit(F&& f) -> std::future<decltype(f())>
+	{
+		auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+		auto result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.emplace([task]() { (*task)(); });
+		}
+		cv.notify_one();
+		return result;
+	}
+
+	// calls func(begin, end) on consecutive ranges of [0, n) no longer than grain and returns when all of them are done,
+	// the calling thread takes part in the work, so it is safe to call from inside a task
+	void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& func);
+
+private:
+	void work();
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool stopping = false;
+};
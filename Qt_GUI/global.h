@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <unordered_map>
 #include <memory>
@@ -15,6 +17,8 @@
 const static int CANVAS_WIDTH = 1600;
 const static int CANVAS_HEIGHT = 900;
 
+const static qint64 SECONDS_PER_DAY = 86400;
+
 const static struct {
 	const int left = 20;
 	const int right = 20;
@@ -27,18 +31,88 @@ struct LabeledPoint
 {
 	QPointF pos;
 	uint label;
-	std::unique_ptr<QDate> date;
+	qint64 time = 0; // params.time_unit seconds since 1970-01-01 UTC, only set in the streaming setting
 	LabeledPoint() {}
-	LabeledPoint(double x, double y, uint l, std::unique_ptr<QDate> d) : pos(x, y), label(l), date(move(d)) {}
-	LabeledPoint(const std::unique_ptr<LabeledPoint>& p) : pos(p->pos), label(p->label),
-		date(p->date ? std::make_unique<QDate>(p->date->year(), p->date->month(), p->date->day()) : nullptr) {}
+	LabeledPoint(double x, double y, uint l, qint64 t = 0) : pos(x, y), label(l), time(t) {}
 };
-typedef std::vector<std::unique_ptr<LabeledPoint>> PointSet;
+typedef std::vector<LabeledPoint> PointSet;
+
+// points stored column by column, the i-th entries of all columns form the i-th point
+struct PointStore {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<uint> label;
+	std::vector<qint64> time; // see LabeledPoint::time, empty unless in the streaming setting
+	std::vector<uint> id; // the index of the point in the data source, ascending
+	std::vector<uint> cell; // the cell of the finest grid, x * vertical_bin_num + y, see filterScaleAndBin()
 
-typedef std::unordered_map<uint, std::unique_ptr<LabeledPoint>> FilteredPointSet;
+	size_t size() const { return id.size(); }
+	bool empty() const { return id.empty(); }
+	void clear() { x.clear(), y.clear(), label.clear(), time.clear(), id.clear(), cell.clear(); }
+	// appends the i-th point of *other*, whose id must be larger than the ones stored
+	void push_back(const PointStore& other, size_t i)
+	{
+		x.push_back(other.x[i]), y.push_back(other.y[i]), label.push_back(other.label[i]), id.push_back(other.id[i]);
+		if (!other.time.empty()) time.push_back(other.time[i]);
+		if (!other.cell.empty()) cell.push_back(other.cell[i]);
+	}
+	// appends the points of *other*, whose ids must be larger than the ones stored
+	void append(const PointStore& other)
+	{
+		x.insert(x.end(), other.x.begin(), other.x.end());
+		y.insert(y.end(), other.y.begin(), other.y.end());
+		label.insert(label.end(), other.label.begin(), other.label.end());
+		time.insert(time.end(), other.time.begin(), other.time.end());
+		id.insert(id.end(), other.id.begin(), other.id.end());
+		cell.insert(cell.end(), other.cell.begin(), other.cell.end());
+	}
+	// the position of the point with the given id, which must be stored
+	size_t indexOf(uint point_id) const { return std::lower_bound(id.begin(), id.end(), point_id) - id.begin(); }
+	LabeledPoint at(size_t i) const { return LabeledPoint(x[i], y[i], label[i], time.empty() ? 0 : time[i]); }
+};
 
 typedef std::vector<uint> Indices;
 
+// a chunk of points stored column by column, the columns are owned by the data source
+struct PointChunk {
+	const float* x;
+	const float* y;
+	const uint* label;
+	const qint64* time; // seconds since 1970-01-01 UTC, nullptr if the data has no date column
+	size_t size;
+};
+
+// a heap array of n value-initialized elements whose first element is aligned for vector loads
+template<class T>
+class AlignedBuffer
+{
+public:
+	const static size_t ALIGNMENT = 64;
+
+	AlignedBuffer() {}
+	explicit AlignedBuffer(size_t n) { resize(n); }
+
+	// discards the content and holds n value-initialized elements
+	void resize(size_t n)
+	{
+		storage.reset(new char[n * sizeof(T) + ALIGNMENT]);
+		auto addr = reinterpret_cast<std::uintptr_t>(storage.get());
+		ptr = reinterpret_cast<T*>((addr + ALIGNMENT - 1) & ~static_cast<std::uintptr_t>(ALIGNMENT - 1));
+		len = n;
+		std::fill(ptr, ptr + n, T());
+	}
+	T* data() { return ptr; }
+	const T* data() const { return ptr; }
+	size_t size() const { return len; }
+	T& operator[](size_t i) { return ptr[i]; }
+	const T& operator[](size_t i) const { return ptr[i]; }
+
+private:
+	std::unique_ptr<char[]> storage;
+	T* ptr = nullptr;
+	size_t len = 0;
+};
+
 struct Extent {
 	qreal x_min;
 	qreal y_min;
@@ -78,4 +152,15 @@ struct Param {
 	uint time_step;
 	uint time_window;
 	bool use_alpha_channel;
+	uint time_unit; // the length of a time step in seconds, SECONDS_PER_DAY for daily data
+	uint history_frames; // the number of recent frames kept in memory in streaming mode, the older ones are spilled to disk
+	uint half_life; // if not 0, the points of a stream fade out by half every half_life time steps instead of leaving the time window
+	uint base_grid_width; // if not 0, the width of a finer grid kept besides grid_width, so that changing grid_width to a multiple of it needs no reload
+	bool class_channels; // whether the finest density of every class is kept in a static setting, so that selecting classes needs no reload
 };
+
+// converts seconds since 1970-01-01 to the number of whole time units, rounding towards the past
+inline qint64 toTimeUnits(qint64 seconds, qint64 unit)
+{
+	return seconds >= 0 ? seconds / unit : -((-seconds + unit - 1) / unit);
+}
@@ -9,11 +9,17 @@
   Files - Descriptions
 * main.cpp - the entry file
 * global.h - constants & type definitions
-* utils.* - reading data & preprocessing
+* utils.* - preprocessing
+* CSVReader.* - reading data from memory-mapped csv files
+* PointFile.* - binary columnar point files (*.pbs) & the csv converter
+*	MappedFile.* - read-only memory mapping of a file
+* ThreadPool.* - worker threads shared by the parallel stages
 * qt_gui.* - window definition
 *	SamplingProcessViewer.* - the graphic screen & create a sampling thread
 *		samplingworker.* - invoking sampling methods in worker thread
 *			HierarchicalSampling.* - our progressive pyramid-based sampling method (**)
+*				PyramidKernels.* - SIMD 2x2 reductions building the pyramid levels
+*				FrameHistory.* - the selected cells of every frame as keyframes & deltas
 *			AdaptiveBinningSampling.* - the kd-tree based sampling method (doi: 10.1109/TVCG.2019.2934541)
 *				BinningTree.* - The tree structure of the kd-tree based sampling method
 *			ReservoirSampling.* - the optimal reservoir sampling (see https://en.wikipedia.org/wiki/Reservoir_sampling#An_optimal_algorithm)
@@ -24,13 +30,25 @@
 *********************************************************************************/
 
 #include "qt_gui.h"
+#include "PointFile.h"
 #include <QtWidgets/QApplication>
 
-Param params = { 100000,0,6,6,10,0.1,0.2,0.25,false,1,30,false };
+Param params = { 100000,0,6,6,10,0.1,0.2,0.25,false,1,30,false,SECONDS_PER_DAY,1024,0,0,false };
 std::vector<int> selected_class_order{ 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19 };
 
 int main(int argc, char *argv[])
 {
+	if (argc >= 4 && std::string(argv[1]) == "--convert") { // Qt_GUI --convert input.csv output.pbs [--streaming]
+		try {
+			convertToPointFile(argv[2], argv[3], argc >= 5 && std::string(argv[4]) == "--streaming");
+		}
+		catch (const std::exception& e) {
+			qDebug() << e.what();
+			return 1;
+		}
+		return 0;
+	}
+
 	QApplication a(argc, argv);
 	Qt_GUI w;
 	w.show();
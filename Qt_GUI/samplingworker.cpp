@@ -4,23 +4,19 @@ void SamplingWorker::readAndSample()
 {
 	int frame_id = 1;
 	qDebug() << "starting...";
-	while (!data_source.eof()) {
+	// chunk N+1 is read, filtered and scaled by the prefetcher while chunk N is being sampled
+	prefetch_done = false;
+	std::thread prefetcher(&SamplingWorker::prefetch, this, point_count);
+	PreparedChunk chunk;
+	while (takePrepared(&chunk)) {
 		auto start = std::chrono::high_resolution_clock::now();
-		PointSet* data_chunk = readDataSource(data_source, class2label);
-		if (point_count == 0) {
-			real_extent = getExtent(data_chunk); // use the extent of the first batch for the whole data
-		}
-		if (data_chunk->empty()) {
-			delete data_chunk;
-			continue;
-		}
-
-		_filtered_new_data = filter(data_chunk, real_extent, point_count);
-		linearScale(_filtered_new_data, real_extent, visual_extent);
+		_filtered_new_data = chunk.points;
 
 		// run sampling methods
-		_result = hs.execute(_filtered_new_data, point_count == 0);
-		seeds = hs.getSeedIndices();
+		{
+			std::lock_guard<std::mutex> lock(sampling_mutex);
+			_result = hs.execute(_filtered_new_data, point_count == 0);
+		}
 		//_result = abs.executeWithoutCallback(_filtered_new_data, { QRect(MARGIN.left, MARGIN.top, CANVAS_WIDTH - MARGIN.left - MARGIN.right, CANVAS_HEIGHT - MARGIN.top - MARGIN.bottom) }, point_count == 0);
 		//_result = rs.execute(_filtered_new_data, point_count == 0);
 		//_result = rands.execute(_filtered_new_data);
@@ -28,22 +24,104 @@ void SamplingWorker::readAndSample()
 		//qDebug() << _result->second.size();
 
 		// post-processing
-		point_count += data_chunk->size();
+		point_count += chunk.size;
 		emit readFinished(_filtered_new_data);
 		emit sampleFinished(_result);
 		emit writeFrame(frame_id);
 		++frame_id;
-		delete data_chunk;
 	}
+	prefetcher.join();
 	emit finished();
 }
 
+void SamplingWorker::resample()
+{
+	publish(&HierarchicalSampling::resample);
+}
+
+void SamplingWorker::regrid()
+{
+	publish(&HierarchicalSampling::regrid);
+}
+
+void SamplingWorker::reclassify()
+{
+	if (!publish(&HierarchicalSampling::reclassify))
+		emit reclassifyFailed();
+}
+
+bool SamplingWorker::publish(std::pair<PointSet, PointSet>* (HierarchicalSampling::*step)())
+{
+	int frame_id;
+	{
+		std::lock_guard<std::mutex> lock(sampling_mutex);
+		_result = (hs.*step)();
+		frame_id = hs.getFrameID();
+	}
+	if (!_result) return false;
+	emit sampleFinished(_result);
+	emit writeFrame(frame_id + 1);
+	return true;
+}
+
+Indices SamplingWorker::getSelected()
+{
+	std::lock_guard<std::mutex> lock(sampling_mutex);
+	return hs.getSeedIndices();
+}
+
 void SamplingWorker::setDataSource(const std::string& data_path)
 {
-	data_source.close();
+	csv_source.close();
+	point_file_source.close();
 	point_count = 0;
 
-	openDataSource(data_source, data_path);
+	use_point_file = isPointFile(data_path);
+	if (use_point_file)
+		point_file_source.open(data_path);
+	else
+		csv_source.open(data_path);
+}
+
+void SamplingWorker::prefetch(uint pos)
+{
+	while (!dataSourceEnd()) {
+		size_t chunk_size;
+		PointStore* filtered = readAndFilter(pos, &chunk_size);
+		if (!filtered)
+			continue;
+		pos += chunk_size;
+
+		std::unique_lock<std::mutex> lock(prefetch_mutex);
+		prefetch_cv.wait(lock, [this]() { return prepared.size() < PREFETCH_DEPTH; });
+		prepared.push_back({ filtered, chunk_size });
+		prefetch_cv.notify_all();
+	}
+	std::lock_guard<std::mutex> lock(prefetch_mutex);
+	prefetch_done = true;
+	prefetch_cv.notify_all();
+}
+
+bool SamplingWorker::takePrepared(PreparedChunk* chunk)
+{
+	std::unique_lock<std::mutex> lock(prefetch_mutex);
+	prefetch_cv.wait(lock, [this]() { return !prepared.empty() || prefetch_done; });
+	if (prepared.empty())
+		return false;
+	*chunk = prepared.front();
+	prepared.pop_front();
+	prefetch_cv.notify_all();
+	return true;
+}
+
+PointStore* SamplingWorker::readAndFilter(uint pos, size_t* chunk_size)
+{
+	PointChunk chunk = use_point_file ? point_file_source.read(class2label) : csv_source.read(class2label);
+	if (pos == 0) {
+		real_extent = getExtent(chunk); // use the extent of the first batch for the whole data
+	}
+	*chunk_size = chunk.size;
+	return chunk.size == 0 ? nullptr : filterScaleAndBin(chunk, real_extent, visual_extent, pos);
 }
 
 void SamplingWorker::updateGrids()
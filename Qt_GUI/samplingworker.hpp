@@ -1,7 +1,14 @@
 ﻿#pragma once
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 #include "global.h"
 #include "utils.h"
+#include "CSVReader.h"
+#include "PointFile.h"
 #include "HierarchicalSampling.h"
 #include "AdaptiveBinningSampling.h"
 #include "ReservoirSampling.h"
@@ -11,12 +18,13 @@ class SamplingWorker : public QObject {
 	Q_OBJECT
 
 public:
-	SamplingWorker() { openDataSource(data_source, MY_DATASET_FILENAME); }
+	SamplingWorker() { csv_source.open(MY_DATASET_FILENAME); }
 	uint getPointCount() { return point_count; }
-	const std::vector<uint>& getSelected() { return seeds; }
+	// a copy of the index of the selected points of the last frame, taken between two sampling steps
+	Indices getSelected();
 	PointSet getSeedsOfSpecificFrame() { return hs.getSeeds(); }
 
-	// open a input stream with the given path
+	// open a csv file or a point file (*.pbs) with the given path
 	void setDataSource(const std::string& data_path);
 	void setClassMapping(std::unordered_map<uint, std::string>* class_mapping) { class2label = class_mapping; }
 	// recreate the density maps with the latest grid size for HierarchicalSampling
@@ -24,25 +32,59 @@ public:
 
 public slots:
 	void readAndSample();
+	// sample the points of the last frame again after a change of the sampling params
+	void resample();
+	// sample the points read so far on the grid of the new grid width if they need not be read again
+	void regrid();
+	// sample the points read so far again with the classes in selected_class_order if they need not be read again,
+	// emits reclassifyFailed() otherwise
+	void reclassify();
 
 signals:
-	void readFinished(FilteredPointSet* filtered_points);
+	void readFinished(PointStore* filtered_points);
 	void sampleFinished(std::pair<PointSet, PointSet>* removed_n_added);
 	void writeFrame(int frame_id);
+	void reclassifyFailed();
 	void finished();
 
 private:
+	// a chunk that is read, filtered and scaled, waiting to be sampled
+	struct PreparedChunk {
+		PointStore* points;
+		size_t size; // number of points read, including the filtered out ones
+	};
+	// the number of prepared chunks the prefetcher may run ahead of the sampling
+	const static size_t PREFETCH_DEPTH = 2;
+
+	// read the next chunk of the data source, whose first point gets the id pos, and filter, scale and bin it,
+	// returns nullptr if the chunk is empty
+	PointStore* readAndFilter(uint pos, size_t* chunk_size);
+	// runs in its own thread and feeds prepared chunks to readAndSample() until the data source ends
+	void prefetch(uint pos);
+	// waits for the next prepared chunk, returns false if there are no more chunks
+	bool takePrepared(PreparedChunk* chunk);
+	// runs a step of HierarchicalSampling that samples the data read so far again and hands its result to the viewer,
+	// returns false if there is none
+	bool publish(std::pair<PointSet, PointSet>* (HierarchicalSampling::*step)());
+	bool dataSourceEnd() { return use_point_file ? point_file_source.eof() : csv_source.eof(); }
+
 	HierarchicalSampling hs{ QRect(MARGIN.left, MARGIN.top, CANVAS_WIDTH - MARGIN.left - MARGIN.right, CANVAS_HEIGHT - MARGIN.top - MARGIN.bottom) };
 	ReservoirSampling rs;
 	AdaptiveBinningSampling abs;
 	RandomSampling rands;
 
-	Indices seeds;
 	uint point_count = 0;
-	FilteredPointSet* _filtered_new_data = nullptr; // used to draw 
+	PointStore* _filtered_new_data = nullptr; // used to draw 
 	std::pair<PointSet, PointSet>* _result = nullptr;
+	std::mutex sampling_mutex; // held while hs samples, the seed indices are only copied out between two steps
 
 	std::unordered_map<uint, std::string>* class2label;
-	std::ifstream data_source;
+	CSVReader csv_source;
+	PointFileReader point_file_source;
+	bool use_point_file = false;
+	std::deque<PreparedChunk> prepared;
+	bool prefetch_done = false;
+	std::mutex prefetch_mutex;
+	std::condition_variable prefetch_cv;
 	Extent real_extent, visual_extent = { (qreal)MARGIN.left, (qreal)MARGIN.top, (qreal)(CANVAS_WIDTH - MARGIN.right), (qreal)(CANVAS_HEIGHT - MARGIN.bottom) };
 };
@@ -1,83 +1,102 @@
 #include "utils.h"
 
-using namespace std;
+#include <cstdint>
 
-void openDataSource(ifstream& input, string filename)
-{
-	input.open(filename);
-	if (!input) //TODO opening error, should throw exception and show error message
-		throw exception();
-	
-	//skip invalid char
-	while ((char)input.get() < 0);
-	input.unget();
-}
-
-PointSet * readDataSource(ifstream& input, unordered_map<uint, string>* class2label)
-{
-	unordered_map<string, uint> label2class;
-	for (auto &u : *class2label)
-		label2class.emplace(u.second, u.first);
-
-	PointSet* points = new PointSet();
-	string value;
-	double x = 0, y = 0;
-	int count = 0;
-	unique_ptr<QDate> d = nullptr;
-	streampos pos = input.tellg();
-	while (getline(input, value, ',')) {
-		if (params.is_streaming) {
-			d = make_unique<QDate>(QDate::fromString(QString(value.c_str()), "yyyy-MM-dd"));
-			if (!points->empty() && points->back()->date->daysTo(*d) >= params.time_step) {
-				input.seekg(pos);
-				break;
-			}
-			getline(input, value, ',');
-		}
-		else if(count == params.chunk_size) {
-			input.seekg(pos);
-			break;
-		}
-		x = atof(value.c_str());
-		getline(input, value, ',');
-		y = atof(value.c_str());
-
-		getline(input, value, '\n');
-
-		if (label2class.find(value) == label2class.end()) { // mapping label (string) to class (unsigned int)
-			auto sz = label2class.size();
-			label2class[value] = sz;
-			class2label->emplace(label2class[value], value);
-		}
-		points->push_back(make_unique<LabeledPoint>(x, y, label2class[value], move(d)));
-		++count;
-		pos = input.tellg();
-	}
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UTILS_USE_SSE2
+#include <emmintrin.h>
+#endif
 
-	return points;
-}
+using namespace std;
 
-FilteredPointSet* filter(PointSet * points, const Extent& ext, uint pos)
+PointStore* filterScaleAndBin(const PointChunk& chunk, const Extent& real_extent, const Extent& visual_extent, uint pos)
 {
-	auto copy = new FilteredPointSet();
-	for (uint i = 0, sz = points->size(); i < sz; ++i) {
-		auto &p = points->at(i);
-		if (p->pos.x() > ext.x_min && p->pos.x() < ext.x_max && p->pos.y() > ext.y_min && p->pos.y() < ext.y_max &&
-			std::find(selected_class_order.begin(), selected_class_order.end(), p->label) != selected_class_order.end()) {
-			copy->insert(make_pair(pos + i, move(p)));
-		}
+	const ClassMask mask;
+	// with class channels the sampler drops the unselected classes itself, so that selecting them again needs no reload
+	const bool all_classes = params.class_channels && !params.is_streaming;
+	// the scaling of linearScale(points, real_extent, visual_extent) as x' = ax * x + bx, y' = ay * y + by
+	const double ax = (visual_extent.x_max - visual_extent.x_min) / (real_extent.x_max - real_extent.x_min),
+		bx = visual_extent.x_min - real_extent.x_min * ax,
+		ay = (visual_extent.y_min - visual_extent.y_max) / (real_extent.y_max - real_extent.y_min),
+		by = visual_extent.y_max - real_extent.y_min * ay;
+	// the extent comes from getExtent() on float columns, so comparing in float is exact
+	const float x_min = static_cast<float>(real_extent.x_min), x_max = static_cast<float>(real_extent.x_max),
+		y_min = static_cast<float>(real_extent.y_min), y_max = static_cast<float>(real_extent.y_max);
+	const float margin_x = static_cast<float>(visual_extent.x_min), margin_y = static_cast<float>(visual_extent.y_min);
+	const int grid_width = static_cast<int>(params.grid_width);
+	const uint stride = binNum(visual_extent.y_max - visual_extent.y_min);
+
+	auto out = new PointStore();
+	out->x.resize(chunk.size), out->y.resize(chunk.size), out->label.resize(chunk.size), out->id.resize(chunk.size), out->cell.resize(chunk.size);
+	if (params.is_streaming)
+		out->time.resize(chunk.size);
+	size_t n = 0;
+	auto accept = [&](size_t i, float x, float y, uint cell) {
+		out->x[n] = x, out->y[n] = y, out->label[n] = chunk.label[i], out->id[n] = pos + static_cast<uint>(i), out->cell[n] = cell;
+		if (params.is_streaming)
+			out->time[n] = chunk.time ? toTimeUnits(chunk.time[i], params.time_unit) : 0;
+		++n;
+	};
+
+	size_t i = 0;
+#ifdef UTILS_USE_SSE2
+	const __m128 v_x_min = _mm_set1_ps(x_min), v_x_max = _mm_set1_ps(x_max), v_y_min = _mm_set1_ps(y_min), v_y_max = _mm_set1_ps(y_max),
+		v_margin_x = _mm_set1_ps(margin_x), v_margin_y = _mm_set1_ps(margin_y), v_half = _mm_set1_ps(0.5f),
+		v_inv_width = _mm_set1_ps(1.0f / grid_width), v_stride = _mm_set1_ps(static_cast<float>(stride));
+	const __m128d v_ax = _mm_set1_pd(ax), v_bx = _mm_set1_pd(bx), v_ay = _mm_set1_pd(ay), v_by = _mm_set1_pd(by);
+	// scales in double precision like the scalar path, then rounds to float
+	auto scale = [](__m128 v, __m128d a, __m128d b) {
+		__m128d lo = _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(v), a), b),
+			hi = _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(v, v)), a), b);
+		return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+	};
+	// static_cast<int>(v - margin) / grid_width, the quotient is exact as (t + 0.5) / grid_width never lies near an integer
+	auto bin = [&](__m128 v, __m128 margin) {
+		__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_sub_ps(v, margin)));
+		return _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(t, v_half), v_inv_width)));
+	};
+	alignas(16) float xs[4], ys[4], cells[4];
+	for (; i + 4 <= chunk.size; i += 4) {
+		__m128 x = _mm_loadu_ps(chunk.x + i), y = _mm_loadu_ps(chunk.y + i);
+		__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(x, v_x_min), _mm_cmplt_ps(x, v_x_max)),
+			_mm_and_ps(_mm_cmpgt_ps(y, v_y_min), _mm_cmplt_ps(y, v_y_max)));
+		int accepted = _mm_movemask_ps(inside);
+		if (!all_classes)
+			accepted &= mask.test(chunk.label[i]) | mask.test(chunk.label[i + 1]) << 1 | mask.test(chunk.label[i + 2]) << 2 | mask.test(chunk.label[i + 3]) << 3;
+		if (!accepted) continue;
+
+		__m128 sx = scale(x, v_ax, v_bx), sy = scale(y, v_ay, v_by);
+		// cell numbers stay far below 2^24, so they are exact in float
+		__m128 cell = _mm_add_ps(_mm_mul_ps(bin(sx, v_margin_x), v_stride), bin(sy, v_margin_y));
+		_mm_store_ps(xs, sx), _mm_store_ps(ys, sy), _mm_store_ps(cells, cell);
+		for (int k = 0; k < 4; ++k)
+			if (accepted >> k & 1)
+				accept(i + k, xs[k], ys[k], static_cast<uint>(cells[k]));
 	}
-	return copy;
+#endif
+	for (; i < chunk.size; ++i) {
+		float x = chunk.x[i], y = chunk.y[i];
+		if (!(x > x_min && x < x_max && y > y_min && y < y_max && (all_classes || mask.test(chunk.label[i]))))
+			continue;
+		float sx = static_cast<float>(x * ax + bx), sy = static_cast<float>(y * ay + by);
+		uint cell = static_cast<uint>(static_cast<int>(sx - margin_x) / grid_width) * stride + static_cast<int>(sy - margin_y) / grid_width;
+		accept(i, sx, sy, cell);
+	}
+
+	out->x.resize(n), out->y.resize(n), out->label.resize(n), out->id.resize(n), out->cell.resize(n);
+	if (params.is_streaming)
+		out->time.resize(n);
+	return out;
 }
 
-void linearScale(FilteredPointSet* points, const Extent& real_extent, double lower, double upper)
+void linearScale(PointStore* points, const Extent& real_extent, double lower, double upper)
 {
 	auto scale = [=](double val, double oldLower, double oldUpper) { return linearScale(val, oldLower, oldUpper, lower, upper); };
 
 	linearScale(points, real_extent, scale, scale);
 }
 
-void linearScale(FilteredPointSet* points, const Extent& real_extent, int left, int right, int top, int bottom)
+void linearScale(PointStore* points, const Extent& real_extent, int left, int right, int top, int bottom)
 {
 	auto horizontalScale = [=](double val, double oldLower, double oldUpper) { return linearScale(val, oldLower, oldUpper, left, right); };
 	auto verticalScale = [=](double val, double oldLower, double oldUpper) { return linearScale(val, oldLower, oldUpper, bottom, top); };
@@ -85,7 +104,7 @@ void linearScale(FilteredPointSet* points, const Extent& real_extent, int left,
 	linearScale(points, real_extent, horizontalScale, verticalScale);
 }
 
-void linearScale(FilteredPointSet* points, const Extent & real_extent, const Extent & target_extent)
+void linearScale(PointStore* points, const Extent & real_extent, const Extent & target_extent)
 {
 	auto horizontalScale = [=](double val, double oldLower, double oldUpper) { return linearScale(val, oldLower, oldUpper, target_extent.x_min, target_extent.x_max); };
 	auto verticalScale = [=](double val, double oldLower, double oldUpper) { return linearScale(val, oldLower, oldUpper, target_extent.y_max, target_extent.y_min); };
@@ -93,25 +112,25 @@ void linearScale(FilteredPointSet* points, const Extent & real_extent, const Ext
 	linearScale(points, real_extent, horizontalScale, verticalScale);
 }
 
-void linearScale(FilteredPointSet* points, const Extent& real_extent, std::function<double(double, double, double)> horizontalScale, std::function<double(double, double, double)> verticalScale)
+void linearScale(PointStore* points, const Extent& real_extent, std::function<double(double, double, double)> horizontalScale, std::function<double(double, double, double)> verticalScale)
 {
 	auto xScale = [=](double val) { return horizontalScale(val, real_extent.x_min, real_extent.x_max); };
 	auto yScale = [=](double val) { return verticalScale(val, real_extent.y_min, real_extent.y_max); };
 
-	for (auto &p : *points) {
-		p.second->pos.setX(xScale(p.second->pos.x()));
-		p.second->pos.setY(yScale(p.second->pos.y()));
+	for (size_t i = 0, sz = points->size(); i < sz; ++i) {
+		points->x[i] = static_cast<float>(xScale(points->x[i]));
+		points->y[i] = static_cast<float>(yScale(points->y[i]));
 	}
 }
 
-Extent getExtent(const PointSet * points)
+Extent getExtent(const PointChunk& chunk)
 {
 	Extent e = { DBL_MAX,DBL_MAX,-DBL_MAX,-DBL_MAX };
-	for (auto &p : *points) {
-		e.x_min = min(e.x_min, p->pos.x());
-		e.x_max = max(e.x_max, p->pos.x());
-		e.y_min = min(e.y_min, p->pos.y());
-		e.y_max = max(e.y_max, p->pos.y());
+	for (size_t i = 0; i < chunk.size; ++i) {
+		e.x_min = min<qreal>(e.x_min, chunk.x[i]);
+		e.x_max = max<qreal>(e.x_max, chunk.x[i]);
+		e.y_min = min<qreal>(e.y_min, chunk.y[i]);
+		e.y_max = max<qreal>(e.y_max, chunk.y[i]);
 	}
 	return e;
 }
\ No newline at end of file
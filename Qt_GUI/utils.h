@@ -5,25 +5,45 @@
 #include <sstream>
 #include <algorithm>
 #include <functional>
+#include <cstdint>
 
 #include "global.h"
 
 extern Param params;
 extern std::vector<int> selected_class_order;
 
-void openDataSource(std::ifstream& input, std::string filename);
-PointSet* readDataSource(std::ifstream& input, std::unordered_map<uint, std::string>* class2label);
-FilteredPointSet* filter(PointSet* points, const Extent& ext, uint pos);
+// one bit per class, set if the class is in selected_class_order
+class ClassMask
+{
+public:
+	ClassMask()
+	{
+		for (int c : selected_class_order) {
+			if (c < 0) continue;
+			if (static_cast<size_t>(c >> 6) >= words.size())
+				words.resize((c >> 6) + 1);
+			words[c >> 6] |= 1ull << (c & 63);
+		}
+	}
+	bool test(uint c) const { return (c >> 6) < words.size() && (words[c >> 6] >> (c & 63)) & 1; }
+
+private:
+	std::vector<uint64_t> words;
+};
+
+// keeps the points strictly inside real_extent whose classes are selected (all classes with params.class_channels in a static setting), scales them to visual_extent (the y axis is flipped)
+// and bins them into the finest grid of visual_extent in a single pass, the i-th point of the chunk gets the id pos + i
+PointStore* filterScaleAndBin(const PointChunk& chunk, const Extent& real_extent, const Extent& visual_extent, uint pos);
 
 inline double linearScale(double val, double oldLower, double oldUpper, double lower, double upper)
 {
 	return (val - oldLower)*(upper - lower) / (oldUpper - oldLower) + lower;
 }
 // will modify points
-void linearScale(FilteredPointSet* points, const Extent& real_extent, double lower, double upper);
-void linearScale(FilteredPointSet* points, const Extent& real_extent, int left, int right, int top, int bottom);
-void linearScale(FilteredPointSet* points, const Extent& real_extent, const Extent& target_extent);
-void linearScale(FilteredPointSet* points, const Extent& real_extent, std::function<double(double, double, double)> horizontalScale, std::function<double(double, double, double)> verticalScale);
+void linearScale(PointStore* points, const Extent& real_extent, double lower, double upper);
+void linearScale(PointStore* points, const Extent& real_extent, int left, int right, int top, int bottom);
+void linearScale(PointStore* points, const Extent& real_extent, const Extent& target_extent);
+void linearScale(PointStore* points, const Extent& real_extent, std::function<double(double, double, double)> horizontalScale, std::function<double(double, double, double)> verticalScale);
 
 inline double squaredEuclideanDistance(const LabeledPoint * a, const LabeledPoint * b)
 {
@@ -31,7 +51,23 @@ inline double squaredEuclideanDistance(const LabeledPoint * a, const LabeledPoin
 	return dx*dx + dy*dy;
 }
 
-Extent getExtent(const PointSet* data);
+Extent getExtent(const PointChunk& chunk);
+
+// a uniform number in [0, 1) that only depends on key and seed, the finalizer of splitmix64 over both
+inline double hashUniform(uint64_t key, uint64_t seed)
+{
+	uint64_t z = seed + (key + 1) * 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	z ^= z >> 31;
+	return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// the number of bins of params.grid_width covering the given length
+inline uint binNum(qreal length)
+{
+	return static_cast<uint>(length) / params.grid_width + 1;
+}
 
 inline int visual2grid(qreal pos, qreal margin)
 {